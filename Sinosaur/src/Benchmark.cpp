@@ -0,0 +1,75 @@
+#include "Benchmark.h"
+#include "SineKernel.h"
+#include "Modulation.h"
+#include <cmath>
+
+Benchmark benchmark;
+
+void Benchmark::Run()
+{
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		phases[i] = static_cast<uint32_t>((static_cast<uint64_t>(i) << 32) / sampleCount);
+	}
+
+	uint32_t start = DWT->CYCCNT;
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		results[i] = Cordic::SinQ31(phases[i]);
+	}
+	cycles.cordicBlocking = DWT->CYCCNT - start;
+
+	start = DWT->CYCCNT;
+	Cordic::SinQ31(phases, results, sampleCount);
+	cycles.cordicPipelined = DWT->CYCCNT - start;
+
+	start = DWT->CYCCNT;
+	Cordic::SinQ31DMA(phases, results, sampleCount);
+	while (!Cordic::BatchComplete()) {}
+	cycles.cordicDMA = DWT->CYCCNT - start;
+
+	sineKernels.cordic = TestSineKernel<CordicSine>();
+	sineKernels.polynomial = TestSineKernel<PolySine>();
+	sineKernels.wavetable = TestSineKernel<TableSine>();
+
+	TestControlRate();
+}
+
+
+void Benchmark::TestControlRate()
+{
+	// Control and sample stages timed separately so that a block can be costed at the configured ControlRate and with
+	// ControlRate equal to SampleRate (the previous single rate engine) from a single build
+	uint32_t start = DWT->CYCCNT;
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		modulation.CalcControl();
+	}
+	controlRate.control = (DWT->CYCCNT - start) / sampleCount;
+
+	start = DWT->CYCCNT;
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		modulation.OutputEnvelopes(i % BlockSize);
+		modulation.engine.Render(i % BlockSize);
+	}
+	controlRate.sample = (DWT->CYCCNT - start) / sampleCount;
+
+	controlRate.splitBlock = BlockSize * controlRate.sample + BlockSize * controlRate.control / ControlInterval;
+	controlRate.singleBlock = BlockSize * (controlRate.sample + controlRate.control);
+}
+
+
+template<typename Sine>
+Benchmark::KernelResult Benchmark::TestSineKernel()
+{
+	KernelResult result;
+
+	const uint32_t start = DWT->CYCCNT;
+	Sine::SinCosQ31(phases, results, cosResults, sampleCount);
+	result.cycles = DWT->CYCCNT - start;
+
+	result.maxError = 0.0f;
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		const float angle = static_cast<float>(i) * pi_x_2 / sampleCount;
+		result.maxError = std::max(result.maxError, std::abs(Q31ToFloat(results[i]) - std::sin(angle)));
+		result.maxError = std::max(result.maxError, std::abs(Q31ToFloat(cosResults[i]) - std::cos(angle)));
+	}
+	return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "initialisation.h"
+
+// Cycle counts measured at startup for comparing processing alternatives (view in debugger)
+class Benchmark {
+public:
+	void Run();
+
+	static constexpr uint32_t sampleCount = 256;
+
+	struct {
+		uint32_t cordicBlocking;				// Cordic::SinQ31 called for each phase
+		uint32_t cordicPipelined;				// Cordic::SinQ31 array version
+		uint32_t cordicDMA;						// Cordic::SinQ31DMA batch polled until complete
+	} cycles;									// Cycles to calculate sampleCount sines
+
+	struct KernelResult {
+		uint32_t cycles;						// Cycles to calculate sampleCount sines and cosines
+		float maxError;							// Maximum absolute error against std::sin
+	};
+	struct {
+		KernelResult cordic;
+		KernelResult polynomial;
+		KernelResult wavetable;
+	} sineKernels;
+
+	struct {
+		uint32_t control;						// Cycles for one control tick (buttons, envelopes and LFO targets)
+		uint32_t sample;						// Cycles for one sample tick (envelope outputs and engine render)
+		uint32_t splitBlock;					// Cycles per block with control ticks at ControlRate
+		uint32_t singleBlock;					// Cycles per block with a control tick every sample (single rate engine)
+	} controlRate;
+
+private:
+	uint32_t phases[sampleCount];
+	int32_t results[sampleCount];
+	int32_t cosResults[sampleCount];
+
+	template<typename Sine>
+	KernelResult TestSineKernel();
+	void TestControlRate();
+};
+
+extern Benchmark benchmark;
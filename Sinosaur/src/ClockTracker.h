@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Tempo tracker for external clock: median filter over recent intervals rejects outliers and detects tempo changes;
+// a second order phase locked loop then tracks the clock period and predicts the next edge to reject jitter.
+// The median is taken over sums of adjacent interval pairs so that swung clocks (alternating long and short
+// intervals) give a steady period rather than flipping between the two interval lengths
+struct ClockTracker {
+	static constexpr uint32_t medianSize = 5;			// Number of interval pair sums in median
+	static constexpr float relockThreshold = 0.25f;		// Median period differing from tracked period by this fraction restarts tracking
+	static constexpr uint32_t minLockEdges = 4;			// Loop is unstable with faster lock
+
+	float period = 0.0f;						// Tracked clock period in CPU cycles (zero until two edges received)
+	float phaseError = 0.0f;					// Last edge time minus predicted time in CPU cycles
+	uint32_t predicted = 0;						// Predicted time of next edge in CPU cycles
+
+	// Critically damped loop with natural frequency 2 / lockEdges (per clock edge): larger values reject more jitter
+	// but follow gradual tempo changes more slowly
+	void SetLockTime(const uint32_t lockEdges)
+	{
+		const float wn = 2.0f / std::max(lockEdges, minLockEdges);
+		kp = 2.0f * wn;
+		ki = wn * wn;
+	}
+
+	// Returns true if a tracked period is available
+	bool Edge(const uint32_t time)
+	{
+		if (!started) {
+			started = true;
+			lastEdge = time;
+			return false;
+		}
+
+		intervals[index] = time - lastEdge;
+		index = (index + 1) % historySize;
+		count = std::min(count + 1, historySize);
+		lastEdge = time;
+
+		const float median = Median();
+		if (count < historySize || std::abs(median - period) > period * relockThreshold) {
+			period = median;					// Filling history or tempo change: restart loop from median period
+			predicted = time + static_cast<uint32_t>(period);
+			phaseError = 0.0f;
+			return true;
+		}
+
+		// Phase error wrapped to +/- half a period so that missing or extra edges do not disturb the loop
+		float error = static_cast<float>(static_cast<int32_t>(time - predicted));
+		const float cycles = std::round(error / period);
+		error -= cycles * period;
+		predicted += static_cast<int32_t>(cycles * period);
+
+		phaseError = error;
+		period += ki * error;
+		predicted += static_cast<int32_t>(period + kp * error);
+		return true;
+	}
+
+	void Reset()
+	{
+		started = false;
+		period = 0.0f;
+		phaseError = 0.0f;
+		index = 0;
+		count = 0;						// Discards stale intervals from before clock stopped
+	}
+
+private:
+	// Median of adjacent interval pair sums halved (single interval until two are available)
+	float Median() const
+	{
+		if (count == 1) {
+			return static_cast<float>(intervals[0]);
+		}
+		uint32_t sums[medianSize];
+		const uint32_t pairs = count - 1;
+		const uint32_t oldest = index + historySize - count;
+		for (uint32_t i = 0; i < pairs; ++i) {
+			sums[i] = intervals[(oldest + i) % historySize] + intervals[(oldest + i + 1) % historySize];
+		}
+		std::sort(sums, sums + pairs);
+		return 0.5f * static_cast<float>(sums[pairs / 2]);
+	}
+
+	static constexpr uint32_t historySize = medianSize + 1;
+
+	float kp = 0.5f;
+	float ki = 0.0625f;
+	bool started = false;
+	uint32_t lastEdge = 0;
+	uint32_t intervals[historySize];
+	uint32_t index = 0;
+	uint32_t count = 0;
+};
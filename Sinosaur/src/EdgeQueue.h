@@ -0,0 +1,38 @@
+#pragma once
+
+#include "stm32g4xx.h"
+
+// Ring of input edge timestamps (CPU cycles from DWT counter): written by an edge interrupt, read by the output interrupt
+template<uint32_t Size>
+struct EdgeQueue {
+	static_assert((Size & (Size - 1)) == 0, "Queue size must be a power of 2");
+
+	struct Edge {
+		uint32_t time;							// DWT->CYCCNT when edge occurred
+		bool rising;
+	};
+
+	Edge edges[Size];
+	volatile uint32_t write = 0;				// Free running indexes: masked to access ring
+	volatile uint32_t read = 0;
+
+	void Push(const uint32_t time, const bool rising)
+	{
+		if (write - read < Size) {				// Drop edge if reader has fallen behind
+			edges[write & (Size - 1)] = {time, rising};
+			__DMB();							// Ensure edge is stored before it is made visible to reader
+			write = write + 1;
+		}
+	}
+
+	bool Pop(Edge& edge)
+	{
+		if (read == write) {
+			return false;
+		}
+		edge = edges[read & (Size - 1)];
+		__DMB();
+		read = read + 1;
+		return true;
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+// Timing of input edges relative to output blocks; kept free of hardware dependencies so it can be tested on a host
+
+
+// Cycles from edge to time now: edges pushed by a higher priority interrupt after now was read are treated as occurring now
+inline uint32_t EdgeAge(const uint32_t now, const uint32_t time)
+{
+	return static_cast<uint32_t>(std::max<int32_t>(now - time, 0));
+}
+
+
+// Edge received during the previous block, placed at the same sample position in the current block
+struct GateEvent {
+	uint32_t pos;							// Sample in block (0 to blockSize - 1)
+	bool rising;
+	uint32_t offset;						// Time from edge to sample in 1/65536 samples (may exceed a sample for old edges)
+
+	// Edges are placed relative to now, the start of the current block; edges older than a block are applied at once
+	// with their full age in the offset so that phase resets stay aligned with the edge.
+	// Edges popped in time order give non-decreasing positions and placed times
+	static GateEvent Place(const uint32_t now, const uint32_t time, const bool rising, const uint32_t sampleTicks, const uint32_t blockSize)
+	{
+		const uint32_t delay = EdgeAge(now, time);
+		const uint32_t samplesAgo = std::min(delay / sampleTicks, blockSize - 1);
+		const uint64_t remainder = delay - samplesAgo * sampleTicks;
+		return {
+			.pos = blockSize - 1 - samplesAgo,
+			.rising = rising,
+			.offset = static_cast<uint32_t>(std::min((remainder << 16) / sampleTicks, (uint64_t)UINT32_MAX))
+		};
+	}
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "initialisation.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+// Multi-segment envelope (attack, decay, sustain, release) with linear, exponential or logarithmic segment curves.
+// Coefficients are calculated when a segment starts or its settings change so each sample is a single multiply-add.
+// State is fixed point so that even the slowest segments step exactly and deterministically.
+struct Envelope {
+	enum class Curve : uint8_t {linear, exponential, logarithmic};
+	enum Stage : uint8_t {idle, attack, decay, sustain, release, stageCount};
+
+	struct Segment {
+		float level;							// Level at end of segment (0 - 1)
+		float slope;							// Full scale rate in units per second: segment time is distance / slope
+		Curve curve;
+		bool operator==(const Segment&) const = default;
+	};
+
+	// Exponential and logarithmic curves aim past or start before the segment by this fraction of its distance:
+	// smaller values give more pronounced curves
+	static constexpr float curveOvershoot = 0.2f;
+	static constexpr float minSamples = 4.0f;
+
+	Segment segments[stageCount] = {};			// Only attack, decay and release segments are used; sustain holds decay level
+	float sampleRate = SampleRate;				// Samples per second at which Next() is called
+
+	Stage stage = idle;
+	int32_t output = 0;							// Output in q1.31 format (0 - 1)
+	int32_t step = 0;							// Linear segments: added each sample
+	int32_t coef = 0;							// Curved segments: fraction of distance to pivot added each sample in q1.31 format
+	int64_t pivot = 0;							// Curved segments: virtual origin or target (may be outside 0 - 1) in q1.31 format
+	int32_t target = 0;							// Level snapped to at end of segment
+	uint32_t remaining = std::numeric_limits<uint32_t>::max();		// Samples until end of segment
+
+	// Sample rate: advance envelope by one sample using a single multiply-accumulate and saturating add
+	int32_t Next()
+	{
+		const int32_t curve = static_cast<int32_t>(((pivot - output) * coef) >> 31);
+		output = __USAT(__QADD(output, step + curve), 31);		// Saturate to 0 - 1
+		if (--remaining == 0) {
+			output = target;
+			EndSegment();
+		}
+		return output;
+	}
+
+	float Level() const
+	{
+		return static_cast<float>(output) * (1.0f / 2147483648.0f);
+	}
+
+	void Gate(const bool high)
+	{
+		StartSegment(high ? attack : release);
+	}
+
+	// Update segment settings: restart the active segment from the current output if its settings change
+	void SetSegment(const Stage s, const Segment segment)
+	{
+		if (segment != segments[s]) {
+			segments[s] = segment;
+			if (s == stage || (s == decay && stage == sustain)) {
+				StartSegment(s);
+			}
+		}
+	}
+
+	void SetSampleRate(const float rate)
+	{
+		if (rate != sampleRate) {
+			sampleRate = rate;
+			if (stage == attack || stage == decay || stage == release) {
+				StartSegment(stage);
+			}
+		}
+	}
+
+private:
+	void EndSegment()
+	{
+		switch (stage) {
+		case attack:	StartSegment(decay);	break;
+		case decay:		StartSegment(sustain);	break;
+		case release:	StartSegment(idle);		break;
+		default:		StartSegment(stage);	break;		// Hold stages restart after 2^32 samples
+		}
+	}
+
+	void StartSegment(const Stage s)
+	{
+		stage = s;
+		if (s == idle || s == sustain) {
+			Hold(s == idle ? 0.0f : segments[decay].level);
+			return;
+		}
+
+		const Segment& seg = segments[s];
+		const float start = Level();
+		const float distance = seg.level - start;
+		if (distance == 0.0f || seg.slope <= 0.0f) {
+			Hold(seg.level);					// Already at level or zero slope (eg level pot at zero): jump to level
+			EndSegment();						// and move straight to next segment
+			return;
+		}
+
+		// Segment length in samples: at least minSamples so curve coefficients are below 1.0
+		const float samples = std::max(std::abs(distance) / seg.slope * sampleRate, minSamples);
+		remaining = static_cast<uint32_t>(samples);
+		target = ToQ31(seg.level);
+
+		// Exponential: grows away from a virtual origin before the start; logarithmic: decays towards a virtual target past the end
+		// Each sample adds (pivot - output) * coef where coef = 1 - e^(-/+ curveLog / samples); expm1 keeps precision for long segments
+		static constexpr float curveLog = 1.791759469f;		// ln((1 + curveOvershoot) / curveOvershoot)
+		switch (seg.curve) {
+		case Curve::exponential:
+			pivot = static_cast<int64_t>((start - distance * curveOvershoot) * 2147483648.0f);
+			coef = static_cast<int32_t>(-std::expm1(curveLog / samples) * 2147483648.0f);
+			step = 0;
+			break;
+		case Curve::logarithmic:
+			pivot = static_cast<int64_t>((seg.level + distance * curveOvershoot) * 2147483648.0f);
+			coef = static_cast<int32_t>(-std::expm1(-curveLog / samples) * 2147483648.0f);
+			step = 0;
+			break;
+		default:
+			coef = 0;
+			step = static_cast<int32_t>(distance / samples * 2147483648.0f);
+			break;
+		}
+	}
+
+	static int32_t ToQ31(const float level)
+	{
+		return static_cast<int32_t>(std::clamp(level, 0.0f, 1.0f) * 2147483647.0);
+	}
+
+	void Hold(const float level)
+	{
+		output = ToQ31(level);
+		target = output;
+		step = 0;
+		coef = 0;
+		remaining = std::numeric_limits<uint32_t>::max();
+	}
+};
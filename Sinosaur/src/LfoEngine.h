@@ -0,0 +1,217 @@
+#pragma once
+
+#include "initialisation.h"
+#include "fixedPoint.h"
+#include "SineKernel.h"
+#include "Wavetable.h"
+#include <algorithm>
+
+// Per sample LFO state held as structure of arrays to keep the output interrupt's working set dense.
+// Voice n (n > 0) has an FM output modulated by voice n - 1's FM output (voice 0's FM output is its sine output).
+// Companion outputs need a cosine per voice so are only compiled in if Companions is set.
+template<uint32_t Voices, typename Sine = SineBackend, bool Companions = false>
+struct LfoEngine {
+	static constexpr uint32_t voices = Voices;
+
+	uint32_t phase[Voices] = {};			// Position in sine wave in q1.31 format
+	uint32_t phaseInc[Voices] = {};			// Phase increment per sample, interpolated at sample rate
+	int32_t  phaseIncStep[Voices] = {};
+	float    outLevel[Voices] = {};			// Output scaling: 0 - 2047.5
+	float    levelStep[Voices] = {};
+	int32_t  fmDepth[Voices] = {};			// Output level scaled to phase offset for FM of next voice
+	int32_t  fmDepthStep[Voices] = {};
+	int32_t  output[Voices] = {};			// Sine (or wavetable) output in q1.31 format
+	int32_t  fmOutput[Voices] = {};			// FM sine output in q1.31 format
+	int32_t  cosine[Voices] = {};			// Quadrature output in q1.31 format from the same CORDIC operation as sine
+	int32_t  companion[Voices] = {};		// Sine rotated by companion phase offset (quadrature by default)
+	uint32_t resetPhase[Voices] = {};		// Phase set by hard sync (q1.31 format)
+	uint32_t sinePhase[Voices] = {};		// Accumulated phase plus any phase modulation from matrix
+	bool     wavetable[Voices] = {};		// Main output read from wavetables rather than sine
+	uint32_t morph[Voices] = {};			// Wavetable morph position (0 - Wavetable::morphMax)
+
+	struct Rotation {
+		int32_t cos;
+		int32_t sin;
+	} companionRotation[Voices];			// cos and sin of companion phase offset in q1.31 format
+
+	// Ratio lock: voices advance at exact ratio num / den of master accumulator, carrying division remainder so they never drift
+	struct RatioLock {
+		uint32_t num;
+		uint32_t den;
+		uint32_t remainder;					// Remainder of (master increment * num) / den carried to next sample
+										// (master increment * num must fit 32 bits: true for LFO rates)
+		bool enabled;
+	} ratioLock[Voices] = {};
+	uint64_t masterPhase = 0;				// Master phase in q32.32 format: upper word counts whole cycles
+	uint32_t masterInc = 0;					// Master increment when following clock
+	bool masterClock = false;				// Master follows clock increment if set, otherwise voice 0's increment
+
+	// Modulation matrix: compiled in main loop into a flat list of multiply-accumulate ops; ISR runs active ops only
+	struct Destinations {
+		int32_t phase[Voices];				// Phase offset in q1.31 format
+		int32_t phaseInc[Voices];			// Phase increment offset
+		int32_t level[Voices];				// Output level offset in q16.16 format (output level is 0 - 2047.5)
+		int32_t fmDepth[Voices];			// FM depth offset
+	} modDest = {};
+
+	struct ModOp {
+		const int32_t* source;				// Source in q1.31 format
+		int32_t* dest;
+		int32_t amount;						// Destination offset at full scale source
+	};
+	static constexpr uint32_t maxModOps = 16;
+	struct ModOps {
+		ModOp ops[maxModOps];
+		uint32_t count;
+	} modOps[2] = {};						// Double buffered: main loop compiles into inactive list then switches
+	volatile uint32_t activeModOps = 0;
+
+	std::array<DacChannel, Voices> dac;
+	std::array<DacChannel, Voices> fmDac;	// Voice 0 has no FM output
+	std::array<DacChannel, Voices> companionDac = {};	// Optional output for companion signal
+
+	LfoEngine(const std::array<DacChannel, Voices> dac, const std::array<DacChannel, Voices> fmDac)
+	 : dac{dac}, fmDac{fmDac}
+	{
+		for (auto& r : companionRotation) {
+			r = {0, INT32_MAX};					// 90 degrees
+		}
+	}
+
+	// Lock voice to master at ratio num / den (den up to 16, num up to 16): phase aligned to master's position; call from output interrupt
+	void SetRatioLock(const uint32_t voice, const uint32_t num, const uint32_t den)
+	{
+		// Master phase reduced modulo den cycles gives the same voice phase and avoids 64 bit overflow when scaled
+		const uint64_t scaled = (masterPhase % ((uint64_t)den << 32)) * num;
+		phase[voice] = static_cast<uint32_t>(scaled / den);
+		ratioLock[voice] = {num, den, static_cast<uint32_t>(scaled % den), true};
+	}
+
+	void ClearRatioLock(const uint32_t voice)
+	{
+		ratioLock[voice].enabled = false;
+	}
+
+	// Hard sync: reset phase of voices in mask; offset is time since edge in q16.16 samples so waves line up with the edge
+	// Called before Render for the sample, which then adds a full increment, so one increment is removed here
+	void ResetPhase(const uint32_t mask, const uint32_t offset)
+	{
+		for (uint32_t v = 0; v < Voices; ++v) {
+			if (mask & (1 << v)) {
+				if (ratioLock[v].enabled) {
+					SetRatioLock(v, ratioLock[v].num, ratioLock[v].den);		// Locked voices realign to master
+				} else {
+					phase[v] = resetPhase[v] + static_cast<uint32_t>(((uint64_t)phaseInc[v] * offset) >> 16) - phaseInc[v];
+				}
+			}
+		}
+		if ((mask & 1) && !masterClock) {
+			SetMasterPhase(phase[0]);				// Voice 0 is the master: move master and locked voices with it
+		}
+	}
+
+	// Master follows clock increment or voice 0; switching to voice 0 realigns master to voice 0's phase
+	void SetMasterClock(const bool clock)
+	{
+		if (masterClock && !clock) {
+			SetMasterPhase(phase[0]);
+		}
+		masterClock = clock;
+	}
+
+	// Set fractional part of master phase (keeping cycle count) and realign locked voices to it
+	void SetMasterPhase(const uint32_t p)
+	{
+		masterPhase = (masterPhase & 0xFFFFFFFF00000000) | p;
+		for (uint32_t v = 0; v < Voices; ++v) {
+			if (ratioLock[v].enabled) {
+				SetRatioLock(v, ratioLock[v].num, ratioLock[v].den);
+			}
+		}
+	}
+
+	// Offset in q1.31 format (0x40000000 = 90 degrees); may use CORDIC so call before output starts or from the output interrupt
+	void SetCompanionPhase(const uint32_t voice, const uint32_t offset)
+	{
+		static_assert(Companions, "Companion outputs not compiled in");
+		int32_t sin, cos;
+		Sine::SinCosQ31(&offset, &sin, &cos, 1);
+		companionRotation[voice] = {cos, sin};
+	}
+
+	void Render(const uint32_t pos)
+	{
+		// Modulation matrix: sources are read from previous sample's outputs so op order does not matter
+		modDest = {};
+		const ModOps& mod = modOps[activeModOps];
+		for (uint32_t i = 0; i < mod.count; ++i) {
+			*mod.ops[i].dest += MultQ31(*mod.ops[i].source, mod.ops[i].amount);
+		}
+
+		for (uint32_t v = 0; v < Voices; ++v) {
+			outLevel[v] += levelStep[v];
+			fmDepth[v] += fmDepthStep[v];
+			phaseInc[v] += phaseIncStep[v];
+		}
+
+		const uint32_t inc = masterClock ? masterInc : phaseInc[0] + modDest.phaseInc[0];
+		masterPhase += inc;
+
+		float level[Voices];
+		for (uint32_t v = 0; v < Voices; ++v) {
+			if (ratioLock[v].enabled) {
+				RatioLock& r = ratioLock[v];
+				const uint32_t acc = r.remainder + inc * r.num;
+				const uint32_t q = acc / r.den;
+				r.remainder = acc - q * r.den;
+				phase[v] += q;
+			} else if (v == 0 && !masterClock) {
+				phase[0] = static_cast<uint32_t>(masterPhase);	// Voice 0 phase is derived from master so locked ratios stay coherent
+			} else {
+				phase[v] += phaseInc[v] + modDest.phaseInc[v];
+			}
+			sinePhase[v] = phase[v] + modDest.phase[v];
+			level[v] = std::clamp(outLevel[v] + modDest.level[v] * (1.0f / 65536.0f), 0.0f, 2047.5f);
+		}
+
+		// Batch calculation: with CORDIC, function is configured once and each argument issued as soon as the previous results are read
+		if constexpr (Companions) {
+			Sine::SinCosQ31(sinePhase, output, cosine, Voices);
+
+			// Companion signal: sin(phase + offset) = sin(phase).cos(offset) + cos(phase).sin(offset)
+			// Saturating add: rounding of both terms can exceed full scale near +/-1
+			for (uint32_t v = 0; v < Voices; ++v) {
+				companion[v] = __QADD(MultQ31(output[v], companionRotation[v].cos), MultQ31(cosine[v], companionRotation[v].sin));
+				if (companionDac[v].samples != nullptr) {
+					companionDac[v].Set(pos, DacLevel(companion[v], level[v]));
+				}
+			}
+		} else {
+			Sine::SinQ31(sinePhase, output, Voices);
+		}
+
+		// Wavetable voices replace main output using the same phase (companion stays sinusoidal); FM chain follows the wavetable shape
+		for (uint32_t v = 0; v < Voices; ++v) {
+			if (wavetable[v]) {
+				output[v] = Wavetable::Read(sinePhase[v], morph[v]);
+			}
+		}
+
+		// FM sines are calculated serially as each depends on the previous: scale outputs while sine kernel is busy
+		// FM phase offset is Q31 multiply of previous voice's FM sine by its level; wraparound from uint32_t overflow
+		Sine::SetSin();
+		fmOutput[0] = output[0];
+		for (uint32_t v = 1; v < Voices; ++v) {
+			Sine::Start(sinePhase[v] + MultQ31(fmOutput[v - 1], fmDepth[v - 1] + modDest.fmDepth[v - 1]));
+			dac[v - 1].Set(pos, DacLevel(output[v - 1], level[v - 1]));
+			fmOutput[v] = Sine::Result();
+			fmDac[v].Set(pos, DacLevel(fmOutput[v], level[v]));
+		}
+		dac[Voices - 1].Set(pos, DacLevel(output[Voices - 1], level[Voices - 1]));
+	}
+
+	static uint32_t DacLevel(const int32_t sine, const float level)
+	{
+		return static_cast<uint32_t>((Q31ToFloat(sine) + 1.0f) * level);		// Will output value from 0 - 4095
+	}
+};
@@ -1,5 +1,5 @@
 #include <Modulation.h>
-#include "Cordic.h"
+#include "lookupTables.h"
 
 Modulation modulation;
 
@@ -15,118 +15,288 @@ void Modulation::Init()
 		if (lfo.levelMode != LfoMode::ramp)		lfo.levelRampLed.SetHigh();
 		if (lfo.levelMode != LfoMode::swell)	lfo.levelSwellLed.SetHigh();
 	}
+
+	// Gate is edge triggered: start envelopes if gate is already high (segments must be configured first)
+	CalculateEnvelopes();
+	if (envelopes.Gate.IsLow()) {
+		GateEdge({.pos = 0, .rising = true});
+	}
 }
 
 
-void Modulation::CalcLFO()
+bool Modulation::CalcBlock(const uint32_t offset)
 {
 	debugPin1.SetHigh();
+	const uint32_t startCycles = DWT->CYCCNT;
+
+	CheckClock(startCycles);
+	CheckGate(startCycles);
+	uint32_t gateEvent = 0;
+
+	for (uint32_t pos = offset; pos < offset + BlockSize; ++pos) {
+		while (gateEvent < gateEventCount && gateEvents[gateEvent].pos <= pos - offset) {
+			GateEdge(gateEvents[gateEvent++]);
+		}
+		if (++controlCounter >= ControlInterval) {
+			controlCounter = 0;
+			CalcControl();
+		}
+		OutputEnvelopes(pos);
+		engine.Render(pos);
+	}
+
+	// LEDs updated once per block from the last rendered sample
+	const uint32_t last = offset + BlockSize - 1;
+	for (auto& lfo : lfos) {
+		*lfo.ledPwm = engine.dac[lfo.index].Get(last);
+	}
+	*envelopes.ramp.ledPwm = ledGammaTable[envelopes.ramp.dac.Get(last)];
+	*envelopes.swell.ledPwm = ledGammaTable[envelopes.swell.dac.Get(last)];
+
+	if constexpr (BlockSize == 1) {				// Single sample mode: transfer directly to DAC holding registers
+		DAC1->DHR12RD = dacBuffer[0][0];
+		DAC2->DHR12RD = dacBuffer[1][0];
+		DAC3->DHR12RD = dacBuffer[2][0];
+		DAC4->DHR12RD = dacBuffer[3][0];
+	}
 
+	blockCycles.last = DWT->CYCCNT - startCycles;
+	blockCycles.max = std::max(blockCycles.last, blockCycles.max);
+	rateCyclesPeak = std::max(blockCycles.last, rateCyclesPeak);
+	const bool overBudget = blockCycles.last > (cycleBudget << rateShift);
+	if (overBudget) {
+		Overrun();
+	} else if (rateShift > 0 && SysTickVal - lastOverrun > recoveryTime && rateCyclesPeak < (cycleBudget << (rateShift - 1)) * 3 / 4) {
+		SetRateShift(rateShift - 1);				// Quiet period with headroom at the higher rate: step sample rate back up
+	}
+	debugPin1.SetLow();
+	return overBudget;
+}
+
+
+void Modulation::CalcControl()
+{
+	// Control rate: calculate target levels and phase increments which are interpolated at the sample rate
 	CheckButtons();
-	CheckClock();
 	CalculateEnvelopes();
 
+	// Ratio locked LFOs follow master accumulator at clock rate if clock present, otherwise at LFO 1's rate
+	engine.SetMasterClock(clockValid);
+	engine.masterInc = clockPhaseInc[clockMultUnity];
+
 	for (auto& lfo : lfos) {
-		// Set output level
-		float currentLevel = 0.5f;
-		if (lfo.levelMode == LfoMode::ramp) {
-			currentLevel *= envelopes.ramp.output;
-		} else if (lfo.levelMode == LfoMode::swell) {
-			currentLevel *= envelopes.swell.output;
+		const uint32_t v = lfo.index;
+
+		// Snap to previous targets to remove any accumulated interpolation error
+		engine.outLevel[v] = lfo.targetLevel;
+		engine.fmDepth[v] = lfo.targetFmDepth;
+		engine.phaseInc[v] = lfo.targetInc;
+
+		// Target output level and phase increment are cached and only recalculated when their inputs change
+		const Lfo::LevelInputs levelInputs = {lfo.level, lfo.levelMode, EnvelopeLevel(lfo.levelMode)};
+		if (levelInputs != lfo.levelInputs) {
+			lfo.levelInputs = levelInputs;
+			lfo.targetLevel = levelInputs.level * 0.5f * levelInputs.envelope;
+			lfo.targetFmDepth = static_cast<int32_t>(lfo.targetLevel * fmScale);
 		}
-		lfo.outLevel = lfo.level * currentLevel;
 
+		const Lfo::RateInputs rateInputs = {lfo.rate, lfo.rateMode, EnvelopeLevel(lfo.rateMode), clockValid ? clockInterval : 0};
+		if (rateInputs != lfo.rateInputs) {
+			lfo.rateInputs = rateInputs;
 
-		// Set output position in sine wave
-		if (clockValid) {
-			int32_t clkHyst = lfo.rate;
-			if (lfo.rateMode != LfoMode::none) {
-				clkHyst = (uint32_t)((float)clkHyst * ((lfo.rateMode == LfoMode::ramp) ? envelopes.ramp.output : envelopes.swell.output));
+			if (clockValid) {
+				// Select new multiplier only when control leaves the current multiplier's hysteresis window
+				const uint32_t control = std::min((uint32_t)((float)rateInputs.rate * rateInputs.envelope), adcTableSize - 1);
+				const auto& window = clockMultWindows[lfo.clockMult];
+				if (control < window.hystLower || control >= window.hystUpper) {
+					lfo.clockMult = SelectClockMult(control);
+				}
+				lfo.targetInc = clockPhaseInc[lfo.clockMult];		// Precomputed when clock interval changes
+
+			} else {
+				const float speed = lfoRateTable[rateInputs.rate] * rateInputs.envelope;
+				lfo.targetInc = (uint32_t)((speed + 0.001f) * lfoRateScale) << rateShift;
 			}
+		}
 
-			if (std::abs(clkHyst - (int32_t)lfo.clockHysteresis) > 20) {
-				lfo.clockHysteresis = clkHyst;
+		// Ratio lock enabled or ratio changed: align phase to master
+		const Ratio ratio = cfg.ratios[v];
+		const bool locked = cfg.ratioLock && v > 0 && ratio.num > 0 && ratio.num <= 16 && ratio.den > 0 && ratio.den <= 16;
+		auto& lock = engine.ratioLock[v];
+		if (locked && (!lock.enabled || lock.num != ratio.num || lock.den != ratio.den)) {
+			engine.SetRatioLock(v, ratio.num, ratio.den);
+		} else if (!locked && lock.enabled) {
+			engine.ClearRatioLock(v);
+		}
 
-				if (clkHyst < 682)				lfo.clockMult = 8.0f;
-				else if (clkHyst < 1365) 		lfo.clockMult = 4.0f;
-				else if (clkHyst < 2048) 		lfo.clockMult = 2.0f;
-				else if (clkHyst < 2731) 		lfo.clockMult = 1.0f;
-				else if (clkHyst < 3413) 		lfo.clockMult = 0.5f;
-				else 							lfo.clockMult = 0.25f;
-			}
-			uint32_t clockSpeed = static_cast<uint32_t>(lfo.clockMult * static_cast<float>(clockInterval));
+		engine.resetPhase[v] = cfg.resetPhase[v] << 16;
 
-			lfo.lfoCosPos += 4294967295 / clockSpeed;
+		// Wavetable morph position from envelope or fixed setting
+		engine.wavetable[v] = cfg.wavetable[v];
+		if (cfg.morphMode[v] == LfoMode::none) {
+			engine.morph[v] = std::min((uint32_t)cfg.morph[v], Wavetable::morphMax);
+		} else {
+			engine.morph[v] = std::min((uint32_t)(EnvelopeLevel(cfg.morphMode[v]) * Wavetable::morphMax), Wavetable::morphMax);
+		}
 
+		// Per sample steps to interpolate to targets (clock synced rate is applied immediately to stay in sync)
+		engine.levelStep[v] = (lfo.targetLevel - engine.outLevel[v]) * controlIntervalRecip;
+		engine.fmDepthStep[v] = (lfo.targetFmDepth - engine.fmDepth[v]) / (int32_t)ControlInterval;
+		if (clockValid) {
+			engine.phaseInc[v] = lfo.targetInc + lfo.phaseCorrection;
+			engine.phaseIncStep[v] = 0;
 		} else {
-			float speed = std::pow(lfo.rate * reciprocal4096, 2.0f);			// Square the speed to increase resolution at low settings
-			if (lfo.rateMode != LfoMode::none) {
-				speed *= ((lfo.rateMode == LfoMode::ramp) ? envelopes.ramp.output : envelopes.swell.output);
-			}
-			lfo.lfoCosPos += (uint32_t)((speed + 0.001) * 500'000.0f);
+			engine.phaseIncStep[v] = ((int32_t)lfo.targetInc - (int32_t)engine.phaseInc[v]) / (int32_t)ControlInterval;
 		}
-		lfo.output = Cordic::Sin(lfo.lfoCosPos);
-
-
-		// Calculate FM for LFOs 2 and 3
-		if (lfo.index > 0) {
-			static constexpr float float32Bit = std::pow(2, 32);
-			static constexpr float fmScale = std::pow(2, 18);
-			float fm;
-			if (lfo.index == 1) {		// LFO 2 is modulated by LFO 1's sine out
-				fm = lfos[lfo.index - 1].output * lfos[lfo.index - 1].outLevel * fmScale;
-			} else {					// LFO 3 is modulated by LFO 2's fm out
-				fm = lfos[lfo.index - 1].fmOutput * lfos[lfo.index - 1].outLevel * fmScale;
-			}
+	}
+}
 
-			float fmPos = fm + (float)lfo.lfoCosPos;
-			if (fmPos >= float32Bit) fmPos -= float32Bit;
-			if (fmPos < 0.0f) fmPos += float32Bit;
 
-			lfo.fmOutput = Cordic::Sin((uint32_t)fmPos);
-			*lfo.fmDac = static_cast<uint32_t>((lfo.fmOutput + 1.0f) * lfo.outLevel);
-		}
+float Modulation::EnvelopeLevel(const LfoMode mode)
+{
+	switch (mode) {
+	case LfoMode::ramp:		return envelopes.ramp.env.Level();
+	case LfoMode::swell:	return envelopes.swell.env.Level();
+	default:				return 1.0f;
+	}
+}
 
 
-		// Scale output
-		uint32_t out = static_cast<uint32_t>((lfo.output + 1.0f) * lfo.outLevel);			// Will output value from 0 - 4095
-		*lfo.dac = out;
-		*lfo.ledPwm = out;
+void Modulation::CalculateEnvelopes()
+{
+	// Control rate: update segment settings from pots (restarting active segment on change); gate edges start segments
+	auto& ramp = envelopes.ramp;
+	auto& swell = envelopes.swell;
+	ramp.ReadPots();
+	swell.ReadPots();
+
+	const float rampLevel = reciprocal4096 * ramp.levelSetting;
+	const float rampSlope = Envelopes::rampSlope * ramp.levelSetting * rampRateTable[ramp.rateSetting];
+	ramp.env.SetSampleRate(SampleRate >> rateShift);
+	ramp.env.SetSegment(Envelope::attack,  {rampLevel, rampSlope, cfg.rampCurves.attack});
+	ramp.env.SetSegment(Envelope::decay,   {rampLevel, Envelopes::releaseSlope, cfg.rampCurves.decay});	// Lowering level falls to sustain at release rate
+	ramp.env.SetSegment(Envelope::release, {0.0f, Envelopes::releaseSlope, cfg.rampCurves.release});
+
+	const float swellLevel = reciprocal4096 * swell.levelSetting;
+	const float swellSlope = Envelopes::swellSlope * swell.levelSetting * swellRateTable[swell.rateSetting];
+	swell.env.SetSampleRate(SampleRate >> rateShift);
+	swell.env.SetSegment(Envelope::attack,  {swellLevel, swellSlope, cfg.swellCurves.attack});
+	swell.env.SetSegment(Envelope::decay,   {0.0f, swellSlope * Envelopes::swellDecayRatio, cfg.swellCurves.decay});
+	swell.env.SetSegment(Envelope::release, {0.0f, Envelopes::releaseSlope, cfg.swellCurves.release});
+}
+
+
+void Modulation::OutputEnvelopes(const uint32_t pos)
+{
+	// Sample rate: one multiply-add per envelope; q1.31 output (0 - 1) shifted to 12 bit DAC range
+	envelopes.ramp.dac.Set(pos, envelopes.ramp.env.Next() >> 19);
+	envelopes.swell.dac.Set(pos, envelopes.swell.env.Next() >> 19);
+}
+
+
+void Modulation::SetRoute(const uint32_t index, const Route route)
+{
+	if (index < maxRoutes) {
+		cfg.routes[index] = route;
+		matrixChanged = true;
+		config.ScheduleSave();
 	}
+}
 
-	debugPin1.SetLow();
+
+void Modulation::UpdateMatrix()
+{
+	if (matrixChanged) {
+		matrixChanged = false;
+		CompileMatrix();
+	}
 }
 
 
-void Modulation::CalculateEnvelopes()
+const int32_t* Modulation::ModSourcePtr(const ModSource source)
 {
-	// If gate low (input is inverted) increment ramp and swell
-	if (envelopes.Gate.IsLow()) {
-		const float rampRateScaled = std::pow((500.0f + adc.Ramp_Rate) * reciprocal4096, 2.0f);
-		const float rampOut = envelopes.ramp.output + Envelopes::rampInc * adc.Ramp_Level * rampRateScaled;
-		envelopes.ramp.output = std::min(rampOut, reciprocal4096 * adc.Ramp_Level);
-
-		const float swellRateScaled = std::pow((100.0f + adc.Swell_Rate) * reciprocal4096, 2.0f);
-		const float swellOut = envelopes.swell.output + Envelopes::swellInc * adc.Swell_Level * swellRateScaled * envelopes.swellDir;
-		if (swellOut * 4096 >= adc.Swell_Level) {
-			envelopes.swellDir = -0.5f;			// Swell down sounds better slower than up
-		} else {
-			envelopes.swell.output = std::max(swellOut, 0.0f);
-		}
-	} else {
-		// return to zero values without abrupt change
-		if (envelopes.ramp.output > 0.0f) {
-			envelopes.ramp.output = std::max(envelopes.ramp.output - Envelopes::releaseInc, 0.0f);
+	switch (source) {
+	case ModSource::ramp:	return &envelopes.ramp.env.output;
+	case ModSource::swell:	return &envelopes.swell.env.output;
+	case ModSource::lfo1:	return &engine.output[0];
+	case ModSource::lfo2:	return &engine.output[1];
+	case ModSource::lfo3:	return &engine.output[2];
+	case ModSource::fm2:	return &engine.fmOutput[1];
+	case ModSource::fm3:	return &engine.fmOutput[2];
+	default:				return nullptr;
+	}
+}
+
+
+void Modulation::CompileMatrix()
+{
+	// Build active routes into inactive op list with amounts pre-scaled to destination units, then switch lists
+	auto& ops = engine.modOps[engine.activeModOps ^ 1];
+	ops.count = 0;
+
+	for (const auto& route : cfg.routes) {
+		const int32_t* source = ModSourcePtr(route.source);
+		if (source == nullptr || route.amount == 0 || route.lfo >= lfoCount || route.dest >= ModDest::count) {
+			continue;
 		}
-		if (envelopes.swell.output > 0.0f) {
-			envelopes.swell.output = std::max(envelopes.swell.output - Envelopes::releaseInc, 0.0f);
+
+		const float amount = route.amount / 32768.0f;
+		auto& op = ops.ops[ops.count++];
+		op.source = source;
+		switch (route.dest) {
+		case ModDest::rate:
+			op.dest = &engine.modDest.phaseInc[route.lfo];
+			op.amount = static_cast<int32_t>(amount * lfoRateScale) << rateShift;
+			break;
+		case ModDest::level:
+			op.dest = &engine.modDest.level[route.lfo];
+			op.amount = static_cast<int32_t>(amount * 2047.5f * 65536.0f);
+			break;
+		case ModDest::fmDepth:
+			op.dest = &engine.modDest.fmDepth[route.lfo];
+			op.amount = static_cast<int32_t>(amount * 2047.5f * fmScale);
+			break;
+		default:
+			op.dest = &engine.modDest.phase[route.lfo];
+			op.amount = route.amount << 16;
+			break;
 		}
-		envelopes.swellDir = 1.0f;
 	}
-	*envelopes.ramp.ledPwm = uint32_t(std::pow(envelopes.ramp.output, 2.0f) * 4095);
-	*envelopes.ramp.dac = uint32_t(envelopes.ramp.output * 4095);
-	*envelopes.swell.ledPwm = uint32_t(std::pow(envelopes.swell.output, 2.0f) * 4095);
-	*envelopes.swell.dac = uint32_t(envelopes.swell.output * 4095);
+
+	engine.activeModOps ^= 1;
+}
+
+
+void Modulation::Overrun()
+{
+	// Rendering missed a sample or exceeded its cycle budget: halve the sample rate if this persists within a time window
+	++overruns;
+	if (SysTickVal - overrunWindowStart > overrunWindow) {
+		overrunWindowStart = SysTickVal;
+		windowOverruns = 0;
+	}
+	lastOverrun = SysTickVal;
+	if (++windowOverruns >= overrunLimit && rateShift < maxRateShift) {
+		windowOverruns = 0;
+		SetRateShift(rateShift + 1);
+	}
+}
+
+
+void Modulation::SetRateShift(const uint32_t shift)
+{
+	// Rescale per sample clock increments immediately so synced LFOs keep their rate until the next clock edge
+	for (auto& inc : clockPhaseInc) {
+		inc = shift > rateShift ? inc << (shift - rateShift) : inc >> (rateShift - shift);
+	}
+	rateShift = shift;
+	rateCyclesPeak = 0;
+	TIM5->ARR = ((OutputTimerReload + 1) << rateShift) - 1;
+	matrixChanged = true;							// Rate modulation amounts are scaled by sample rate
+
+	for (auto& lfo : lfos) {
+		lfo.rateInputs.rate = 0xFFFF;				// Force recalculation of cached phase increments
+	}
 }
 
 
@@ -173,20 +343,89 @@ void Modulation::CheckButtons()
 }
 
 
-void Modulation::CheckClock()
+void Modulation::CheckClock(const uint32_t now)
+{
+	// Process clock edges timestamped by EXTI interrupt since last block
+	const uint32_t sampleTicks = OutputTimerTicks << rateShift;			// CPU cycles per sample
+	EdgeQueue<8>::Edge edge;
+	while (clockEdges.Pop(edge)) {
+		clockTracker.SetLockTime(cfg.clockLockEdges ? cfg.clockLockEdges : defaultLockEdges);
+		if (clockTracker.Edge(edge.time)) {
+			clockInterval = static_cast<uint32_t>(clockTracker.period + 0.5f);		// Jitter filtered period
+
+			// Precompute phase increment for each multiplier: 1x increment is 2^32 * cycles per sample / cycles per clock
+			const uint64_t unityInc = ((uint64_t)sampleTicks << 32) / clockInterval;
+			for (uint32_t i = 0; i < clockMultCount; ++i) {
+				clockPhaseInc[i] = static_cast<uint32_t>(unityInc * clockMults[i].den / clockMults[i].num);
+			}
+
+			++clockEdgeCount;
+			AlignClockPhases(edge.time - static_cast<int32_t>(clockTracker.phaseError), now);
+		}
+		lastClock = edge.time;
+
+		if (cfg.clockSync) {
+			// Time since edge in q16.16 samples aligns reset phase with the edge itself
+			const uint32_t elapsed = static_cast<uint32_t>(((uint64_t)EdgeAge(now, edge.time) << 16) / sampleTicks);
+			engine.ResetPhase(cfg.clockSync, elapsed + cfg.syncOffset);
+		}
+	}
+	clockValid = clockInterval != 0 && (EdgeAge(now, lastClock) < SystemClock * 2);		// Valid clock interval is within two seconds
+	if (!clockValid && clockInterval != 0) {
+		clockInterval = 0;
+		clockTracker.Reset();					// Clock stopped: lock afresh to next clock as tempo may have changed
+	}
+}
+
+
+void Modulation::AlignClockPhases(const uint32_t gridTime, const uint32_t now)
 {
-	// Check if clock received
-	if (Clock.IsLow()) {		// Clock signal high (inverted)
-		if (!clockHigh) {
-			clockInterval = clockCounter - lastClock;
-			lastClock = clockCounter;
-			clockHigh = true;
+	// Nudge clock synced LFOs towards their expected phase at the jitter filtered clock edge so rounding error in the
+	// phase increment cannot accumulate; a fraction of the error is corrected, spread over the next clock period.
+	// LFOs hard synced to the clock are already placed on the grid by their phase reset
+	const float sampleTicks = OutputTimerTicks << rateShift;
+	const float samplesSinceEdge = static_cast<int32_t>(now - gridTime) / sampleTicks;
+	for (auto& lfo : lfos) {
+		const uint32_t v = lfo.index;
+		if (!cfg.clockAlign || engine.ratioLock[v].enabled || (cfg.clockSync & (1 << v))) {
+			lfo.phaseCorrection = 0;
+			continue;
 		}
-	} else {
-		clockHigh = false;
+
+		// Position in LFO cycle at this edge: multiplier num / den spans num clocks for each den cycles
+		const ClockMult mult = clockMults[lfo.clockMult];
+		const uint32_t cyclePos = (clockEdgeCount % mult.num) * mult.den % mult.num;
+		const uint32_t expected = static_cast<uint32_t>(((uint64_t)cyclePos << 32) / mult.num) + engine.resetPhase[v];
+
+		const uint32_t phaseAtEdge = engine.phase[v] - static_cast<uint32_t>(engine.phaseInc[v] * samplesSinceEdge);
+		const int32_t error = static_cast<int32_t>(expected - phaseAtEdge);
+		lfo.phaseCorrection = static_cast<int32_t>(error * alignGain * sampleTicks / clockInterval);
 	}
-	clockValid = (clockCounter - lastClock < (SampleRate * 2));					// Valid clock interval is within a second
-	++clockCounter;
+}
 
 
+void Modulation::CheckGate(const uint32_t now)
+{
+	// Gate edges timestamped by EXTI interrupt during the previous block are replayed at the same position in this block
+	const uint32_t sampleTicks = OutputTimerTicks << rateShift;			// CPU cycles per sample
+	gateEventCount = 0;
+	EdgeQueue<8>::Edge edge;
+	while (gateEventCount < std::size(gateEvents) && gateEdges.Pop(edge)) {
+		gateEvents[gateEventCount++] = GateEvent::Place(now, edge.time, edge.rising, sampleTicks, BlockSize);
+	}
+}
+
+
+void Modulation::GateEdge(const GateEvent& event)
+{
+	if (event.rising == envelopes.gateHigh) {
+		return;
+	}
+	envelopes.gateHigh = event.rising;
+	envelopes.ramp.env.Gate(event.rising);
+	envelopes.swell.env.Gate(event.rising);
+
+	if (event.rising && cfg.gateSync) {
+		engine.ResetPhase(cfg.gateSync, event.offset + cfg.syncOffset);
+	}
 }
@@ -2,18 +2,62 @@
 
 #include "initialisation.h"
 #include "configManager.h"
+#include "LfoEngine.h"
+#include "Envelope.h"
+#include "EdgeQueue.h"
+#include "EdgeTiming.h"
+#include "ClockTracker.h"
+#include "lookupTables.h"
 
 
 class Modulation {
 public:
 	void Init();
-	void CalcLFO();
+	bool CalcBlock(const uint32_t offset);		// Render BlockSize samples into the DAC buffer from offset: true if over budget (overrun counted)
 
 	enum LfoMode : uint8_t {none = 0, ramp = 1, swell = 2};
 
+	static constexpr uint32_t lfoCount = 3;
+
+	// Modulation matrix routes: any source to rate, level, FM depth or phase of any LFO
+	enum class ModSource : uint8_t {off, ramp, swell, lfo1, lfo2, lfo3, fm2, fm3, count};
+	enum class ModDest : uint8_t {rate, level, fmDepth, phase, count};
+	struct Route {
+		ModSource source;
+		ModDest dest;
+		uint8_t lfo;							// Destination LFO index
+		int16_t amount;							// -1.0 to 1.0 in q15 format
+	};
+	static constexpr uint32_t maxRoutes = 8;
+
+	struct EnvCurves {
+		Envelope::Curve attack;
+		Envelope::Curve decay;
+		Envelope::Curve release;
+	};
+
+	struct Ratio {
+		uint8_t num;
+		uint8_t den;
+	};
+
 	struct Cfg {
-		LfoMode rateMode[3];
-		LfoMode levelMode[3];
+		LfoMode rateMode[lfoCount];
+		LfoMode levelMode[lfoCount];
+		bool wavetable[lfoCount];				// Output morphing wavetable in place of sine
+		LfoMode morphMode[lfoCount];			// Morph controlled by envelope, or fixed position if none
+		uint16_t morph[lfoCount];				// Fixed morph position (0 - 4095)
+		Route routes[maxRoutes];
+		bool ratioLock;							// LFOs 2 and 3 locked to ratios of LFO 1 (or clock if present)
+		Ratio ratios[lfoCount];					// Lock ratios (LFO 1 entry unused); 1 - 16
+		uint8_t clockSync;						// Bit mask of LFOs whose phase is reset on clock edges
+		uint8_t gateSync;						// Bit mask of LFOs whose phase is reset on gate edges
+		uint16_t resetPhase[lfoCount];			// Phase after reset: 0 - 65535 is one cycle
+		bool clockAlign;						// Keep clock synced LFO phases aligned to clock edges
+		uint8_t clockLockEdges;					// Clock tracker lock time in clock edges (0 for default)
+		uint16_t syncOffset;					// Additional sync offset in 1/65536 samples (added to measured time since timestamped edges)
+		EnvCurves rampCurves;
+		EnvCurves swellCurves;
 	};
 	static Cfg cfg;
 
@@ -23,18 +67,66 @@ public:
 		.validateSettings = nullptr
 	};
 
+	struct {
+		uint32_t last;
+		uint32_t max;
+	} blockCycles;								// CPU cycles taken to render a block (for benchmarking)
+
+	void SetRoute(const uint32_t index, const Route route);	// Update modulation matrix route (rebuilt in main loop)
+	void UpdateMatrix();						// Called from main loop to rebuild modulation matrix ops after a change
+
+	EdgeQueue<8> clockEdges;					// Clock edges timestamped by EXTI interrupt
+	EdgeQueue<8> gateEdges;						// Gate rising and falling edges timestamped by EXTI interrupt
+
+	void Overrun();								// Called when rendering misses a sample deadline
+	uint32_t overruns = 0;						// Count of missed samples or blocks exceeding cycle budget
+	uint32_t rateShift = 0;						// Sample rate is reduced by factor 2^rateShift after persistent overruns
+
 private:
+	friend class Benchmark;						// Times control and sample rate stages separately
+
+	void CalcControl();
 	void CalculateEnvelopes();
+	void OutputEnvelopes(const uint32_t pos);
+	float EnvelopeLevel(const LfoMode mode);	// Envelope output controlling rate or level (1.0 if not envelope controlled)
 	void CheckButtons();
-	void CheckClock();
+	void CheckClock(const uint32_t now);
+	void SetRateShift(const uint32_t shift);
+	void AlignClockPhases(const uint32_t gridTime, const uint32_t now);
+	void CheckGate(const uint32_t now);
+	void GateEdge(const GateEvent& event);
+	void CompileMatrix();
+	const int32_t* ModSourcePtr(const ModSource source);
+
+	volatile bool matrixChanged = true;		// Set when routes or their scaling change to trigger recompile in main loop
 
 	GpioPin Clock = {GPIOC, 12, GpioPin::Type::Input};
 
+	static constexpr uint32_t cycleBudget = OutputTimerTicks * BlockSize * 9 / 10;	// Maximum CPU cycles allowed to render a block at full rate
+	static constexpr uint32_t overrunLimit = 4;		// Number of overruns within overrunWindow before each sample rate reduction
+	static constexpr uint32_t overrunWindow = 1000;	// Time window for counting overruns in ms
+	static constexpr uint32_t recoveryTime = 10000;	// Time without overruns in ms before sample rate is stepped back up
+	uint32_t overrunWindowStart = 0;				// SysTick time of start of current overrun window
+	uint32_t windowOverruns = 0;					// Overruns in current window
+	uint32_t lastOverrun = 0;						// SysTick time of last overrun
+	uint32_t rateCyclesPeak = 0;					// Peak block cycles since sample rate last changed
+	static constexpr uint32_t maxRateShift = 2;		// Reduce to a quarter of the full sample rate at most
+	static constexpr float lfoRateScale = 4.6566f * PhaseIncPerHz;		// Maximum free running rate ~4.66Hz
+	static constexpr float fmScale = 1 << 18;		// Scales output level (0 - 2047) to FM phase offset
+
 	bool     clockValid;					// True if a clock pulse has been received within a second
-	uint32_t clockInterval;					// Clock interval in sample time
-	uint32_t clockCounter;					// Counter used to calculate clock times in sample time
-	uint32_t lastClock;						// Time last clock signal received in sample time
-	bool     clockHigh;						// Record clock high state to detect clock transitions
+	ClockTracker clockTracker;				// Filters clock jitter with median filter and phase locked loop
+	static constexpr uint8_t defaultLockEdges = 16;
+	static constexpr float alignGain = 0.25f;	// Fraction of clock phase error corrected over each clock period
+	uint32_t clockEdgeCount = 0;			// Counts tracked clock edges to give expected phase of clock synced LFOs
+	uint32_t clockInterval;					// Tracked clock interval in CPU cycles (zero if no valid clock)
+	uint32_t lastClock;						// Time last clock edge received in CPU cycles
+
+	GateEvent gateEvents[8];				// Gate edges received during the previous block, placed at their sample position in the current block
+	uint32_t gateEventCount = 0;
+	uint32_t controlCounter = ControlInterval - 1;	// Counts samples between control rate updates (first sample triggers update)
+
+	uint32_t clockPhaseInc[clockMultCount];	// Phase increment for each multiplier, updated when clock interval changes
 
 	struct Btn {
 		GpioPin pin;
@@ -56,21 +148,41 @@ private:
 		}
 	};
 
+	// Per sample state in structure of arrays; Lfo holds control rate state and hardware bindings
+	LfoEngine<lfoCount> engine {
+		{DacChannel{3, 1}, DacChannel{1, 2}, DacChannel{1, 1}},
+		{DacChannel{},     DacChannel{3, 2}, DacChannel{2, 1}}
+	};
+	static_assert(maxRoutes <= decltype(engine)::maxModOps, "Modulation matrix routes exceed engine op list size");
+
 	struct Lfo {
-		uint32_t index;							// Index is used to apply fm from previous lfo output
-		uint32_t lfoCosPos = 0;					// Position of cordic cosine wave in q1.31 format
-		uint32_t clockHysteresis;				// Hysteresis to prevent jumping between multipliers when using clock
-		float clockMult;
+		uint32_t index;							// Index of voice in LFO engine
+		uint32_t targetInc;						// Cached phase increment calculated at control rate
+		uint32_t clockMult;						// Index into clockMults
+		int32_t phaseCorrection;				// Added to clock synced phase increment to align phase with clock edges
+
+		// Inputs used to calculate cached level and phase increment: recalculate only when these change
+		struct LevelInputs {
+			uint16_t level;
+			LfoMode mode;
+			float envelope;
+			bool operator==(const LevelInputs&) const = default;
+		} levelInputs = {.level = 0xFFFF};
+
+		struct RateInputs {
+			uint16_t rate;
+			LfoMode mode;
+			float envelope;
+			uint32_t clockInterval;				// Zero if no valid clock
+			bool operator==(const RateInputs&) const = default;
+		} rateInputs = {.rate = 0xFFFF};
 
-		float output;
-		float fmOutput;
-		float outLevel;
+		int32_t targetFmDepth;
+		float targetLevel;
 
 		volatile uint16_t& rate;
 		volatile uint16_t& level;
 
-		volatile uint32_t* dac;
-		volatile uint32_t* fmDac;
 		volatile uint32_t* ledPwm;
 
 		Btn rateBtn;
@@ -85,26 +197,26 @@ private:
 		LfoMode& levelMode = Modulation::cfg.levelMode[index];// = Mode::none;
 
 		Lfo(uint32_t chn, volatile uint16_t& rate, volatile uint16_t& level,
-				volatile uint32_t* dac, volatile uint32_t* fmDac, volatile uint32_t* ledPwm,
+				volatile uint32_t* ledPwm,
 				GpioPin rateBtn, GpioPin levelBtn,
 				GpioPin rateRampLed, GpioPin rateSwellLed,
 				GpioPin levelRampLed, GpioPin levelSwellLed)
-		 : index{chn}, rate{rate}, level{level}, dac{dac}, fmDac{fmDac}, ledPwm{ledPwm}, rateBtn{rateBtn}, levelBtn{levelBtn},
+		 : index{chn}, rate{rate}, level{level}, ledPwm{ledPwm}, rateBtn{rateBtn}, levelBtn{levelBtn},
 		   rateRampLed{rateRampLed}, rateSwellLed{rateSwellLed}, levelRampLed{levelRampLed}, levelSwellLed{levelSwellLed} {};
 
-	} lfos[3] = {
+	} lfos[lfoCount] = {
 		{
-			0, adc.Sine1_Rate, adc.Sine1_Level, &DAC3->DHR12R1, nullptr, &TIM3->CCR3,
+			0, adc.Sine1_Rate, adc.Sine1_Level, &TIM3->CCR3,
 			{GPIOD, 4, GpioPin::Type::InputPullup}, {GPIOD, 1, GpioPin::Type::InputPullup},
 			{GPIOC, 9, GpioPin::Type::Output}, {GPIOB, 10, GpioPin::Type::Output},
 			{GPIOD, 13, GpioPin::Type::Output}, {GPIOC, 6, GpioPin::Type::Output},
 		}, {
-			1, adc.Sine2_Rate, adc.Sine2_Level, &DAC1->DHR12R2, &DAC3->DHR12R2, &TIM3->CCR4,
+			1, adc.Sine2_Rate, adc.Sine2_Level, &TIM3->CCR4,
 			{GPIOD, 5, GpioPin::Type::InputPullup}, {GPIOD, 2, GpioPin::Type::InputPullup},
 			{GPIOA, 15, GpioPin::Type::Output}, {GPIOB, 11, GpioPin::Type::Output},
 			{GPIOD, 14, GpioPin::Type::Output}, {GPIOC, 7, GpioPin::Type::Output},
 		}, {
-			2, adc.Sine3_Rate, adc.Sine3_Level, &DAC1->DHR12R1,&DAC2->DHR12R1,  &TIM2->CCR2,
+			2, adc.Sine3_Rate, adc.Sine3_Level, &TIM2->CCR2,
 			{GPIOD, 6, GpioPin::Type::InputPullup}, {GPIOD, 3, GpioPin::Type::InputPullup},
 			{GPIOD, 12, GpioPin::Type::Output}, {GPIOF, 9, GpioPin::Type::Output},
 			{GPIOD, 15, GpioPin::Type::Output}, {GPIOC, 8, GpioPin::Type::Output},
@@ -112,25 +224,35 @@ private:
 	};
 
 	struct Envelopes {
-		static constexpr float rampInc = 1e-8f;
-		static constexpr float swellInc = 4e-8f;
-		static constexpr float releaseInc = 0.0002f;
+		// Full scale rates in units per second: ramp and swell rates also scale with level so rise time is independent of level
+		static constexpr float rampSlope = 0.0004f;
+		static constexpr float swellSlope = 0.0016f;
+		static constexpr float swellDecayRatio = 0.5f;	// Swell down sounds better slower than up
+		static constexpr float releaseSlope = 8.0f;
+		static constexpr uint16_t potHysteresis = 8;	// Pot changes smaller than this do not restart the active segment
 
 		GpioPin Gate {GPIOD, 0, GpioPin::Type::Input};
-		float swellDir = 1.0f;					// Switches to negative to reverse swell direction
+		bool gateHigh = false;
 
 		struct Env {
 			volatile uint16_t& rate;
 			volatile uint16_t& level;
 
-			volatile uint32_t* dac;
+			DacChannel dac;
 			volatile uint32_t* ledPwm;
 
-			float output;
+			Envelope env;
+			uint16_t rateSetting;				// Pot values with hysteresis applied
+			uint16_t levelSetting;
+
+			void ReadPots() {
+				if (std::abs(rate - rateSetting) > potHysteresis)		rateSetting = rate;
+				if (std::abs(level - levelSetting) > potHysteresis)	levelSetting = level;
+			}
 		};
 
-		Env ramp = { adc.Ramp_Rate, adc.Ramp_Level, &DAC4->DHR12R1, &TIM3->CCR1 };
-		Env swell = { adc.Swell_Rate, adc.Swell_Level, &DAC4->DHR12R2, &TIM3->CCR2 };
+		Env ramp = { adc.Ramp_Rate, adc.Ramp_Level, {4, 1}, &TIM3->CCR1 };
+		Env swell = { adc.Swell_Rate, adc.Swell_Level, {4, 2}, &TIM3->CCR2 };
 
 	} envelopes;
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "initialisation.h"
+#include "fixedPoint.h"
+#include "Cordic.h"
+#include <cmath>
+
+// Interchangeable sine kernels taking a 32 bit phase (full cycle = 2^32) and returning q1.31 results. Each provides:
+//   SinQ31()          batch of sines
+//   SinCosQ31()       batch of sines and cosines
+//   SetSin()          prepare for single sine calculations
+//   Start()/Result()  single sine split so the kernel's latency can be overlapped with other work
+
+struct CordicSine {							// CORDIC peripheral: frees the FPU but is a shared blocking resource
+	static void SinQ31(const uint32_t* x, int32_t* sin, const uint32_t count) {
+		Cordic::SinQ31(x, sin, count);
+	}
+	static void SinCosQ31(const uint32_t* x, int32_t* sin, int32_t* cos, const uint32_t count) {
+		Cordic::SinCosQ31(x, sin, cos, count);
+	}
+	static void SetSin()					{ Cordic::SetSin(); }
+	static void Start(const uint32_t x)		{ Cordic::Write(x); }
+	static int32_t Result()					{ return Cordic::ReadQ31(); }
+};
+
+
+struct PolySine {							// Minimax polynomial on the FPU: max error ~7e-7
+	static int32_t Sin(const uint32_t x)
+	{
+		// Fold phase into -pi/2 to +pi/2 using sin(pi - a) = sin(a)
+		int32_t q = static_cast<int32_t>(x);
+		if (q > 0x40000000 || q < -0x40000000) {
+			q = static_cast<int32_t>(0x80000000 - x);
+		}
+
+		// Odd 7th order polynomial approximating sin(t * pi / 2) for t = -1 to +1 (maximum < 1 so no overflow)
+		const float t = static_cast<float>(q) * (2.0f / 2147483648.0f);
+		const float t2 = t * t;
+		const float s = t * (1.5707910096f + t2 * (-0.6458928341f + t2 * (0.0794343070f + t2 * -0.0043330699f)));
+		return static_cast<int32_t>(s * 2147483648.0f);
+	}
+
+	static void SinQ31(const uint32_t* x, int32_t* sin, const uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i) {
+			sin[i] = Sin(x[i]);
+		}
+	}
+	static void SinCosQ31(const uint32_t* x, int32_t* sin, int32_t* cos, const uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i) {
+			sin[i] = Sin(x[i]);
+			cos[i] = Sin(x[i] + 0x40000000);
+		}
+	}
+	static void SetSin()					{}
+	static void Start(const uint32_t x)		{ arg = x; }
+	static int32_t Result()					{ return Sin(arg); }
+
+	static inline uint32_t arg;
+};
+
+
+struct TableSine {							// Linearly interpolated wavetable in RAM: max error ~5e-6
+	static constexpr uint32_t tableBits = 10;
+	static constexpr uint32_t tableSize = 1 << tableBits;
+
+	static int32_t Sin(const uint32_t x)
+	{
+		const uint32_t i = x >> (32 - tableBits);
+		const int32_t fraction = (x << tableBits) >> 1;			// Position between table entries in q1.31 format
+		return table[i] + MultQ31(table[i + 1] - table[i], fraction);
+	}
+
+	static void SinQ31(const uint32_t* x, int32_t* sin, const uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i) {
+			sin[i] = Sin(x[i]);
+		}
+	}
+	static void SinCosQ31(const uint32_t* x, int32_t* sin, int32_t* cos, const uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i) {
+			sin[i] = Sin(x[i]);
+			cos[i] = Sin(x[i] + 0x40000000);
+		}
+	}
+	static void SetSin()					{}
+	static void Start(const uint32_t x)		{ arg = x; }
+	static int32_t Result()					{ return Sin(arg); }
+
+	static inline uint32_t arg;
+
+	static constexpr std::array<int32_t, tableSize + 1> MakeTable()
+	{
+		std::array<int32_t, tableSize + 1> t {};						// Extra guard entry for interpolation at end of table
+		for (uint32_t i = 0; i <= tableSize; ++i) {
+			t[i] = static_cast<int32_t>(std::sin(i * 2.0 * M_PI / tableSize) * 2147483647.0);
+		}
+		return t;
+	}
+	static inline std::array<int32_t, tableSize + 1> table = MakeTable();	// Not const so held in RAM
+};
+
+
+using SineBackend = CordicSine;				// Select sine kernel used by LFO engine
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "initialisation.h"
+#include <array>
+#include <cmath>
+
+// 16 bit wavetables held in RAM, read with interpolation between adjacent samples and morphing between adjacent tables.
+// Both interpolations use the Cortex-M4 dual 16 bit multiply-accumulate (SMLAD) on sample pairs packed into one word.
+struct Wavetable {
+	enum Waveform : uint8_t {triangle, saw, square, stepped, user, count};
+
+	static constexpr uint32_t tableBits = 8;
+	static constexpr uint32_t tableSize = 1 << tableBits;
+	static constexpr uint32_t morphBits = 12;
+	static constexpr uint32_t morphMax = (1 << morphBits) - 1;			// Morph 0 - 4095 moves through all tables in order
+	static constexpr uint32_t weightBits = 14;							// Interpolation weights in q14 so that 1.0 fits a halfword
+	static constexpr uint32_t weightOne = 1 << weightBits;
+
+	using Table = std::array<int16_t, tableSize + 1>;					// Extra guard entry for interpolation at end of table
+
+	// Phase in q1.31 format as for sine kernels; returns q1.31 output
+	static int32_t Read(const uint32_t phase, const uint32_t morph)
+	{
+		const uint32_t i = phase >> (32 - tableBits);
+		const uint32_t frac = (phase >> (32 - tableBits - weightBits)) & (weightOne - 1);
+		const uint32_t sampleWeights = __PKHBT(weightOne - frac, frac, 16);	// Weight for sample i in low half, i + 1 in high half
+
+		const uint32_t pos = morph * (count - 1);
+		const uint32_t t = pos >> morphBits;
+		const uint32_t morphFrac = (pos & morphMax) << (weightBits - morphBits);
+		const uint32_t tableWeights = __PKHBT(weightOne - morphFrac, morphFrac, 16);
+
+		// Adjacent samples are loaded as a single (unaligned) word: sample i in low half, i + 1 in high half
+		const int32_t a = (int32_t)__SMLAD(__UNALIGNED_UINT32_READ(&tables[t][i]), sampleWeights, 0) >> weightBits;
+		const int32_t b = (int32_t)__SMLAD(__UNALIGNED_UINT32_READ(&tables[t + 1][i]), sampleWeights, 0) >> weightBits;
+
+		return (int32_t)__SMLAD(__PKHBT(a, b, 16), tableWeights, 0) << (31 - 15 - weightBits);
+	}
+
+	static constexpr Table MakeTable(const Waveform waveform)
+	{
+		Table t {};
+		for (uint32_t i = 0; i <= tableSize; ++i) {
+			const float p = (float)(i % tableSize) / tableSize;			// Position in cycle: all shapes start at zero rising like sine
+			float s = 0.0f;
+			switch (waveform) {
+			case triangle:	s = p < 0.25f ? 4.0f * p : p < 0.75f ? 2.0f - 4.0f * p : 4.0f * p - 4.0f;	break;
+			case saw:		s = p < 0.5f ? 2.0f * p : 2.0f * p - 2.0f;	break;
+			case square:	s = p < 0.5f ? 1.0f : -1.0f;				break;
+			case stepped:	s = std::round(std::sin(p * 2.0f * (float)M_PI) * 4.0f) / 4.0f;	break;	// Sine quantised to 9 levels
+			default:		s = std::sin(p * 2.0f * (float)M_PI);		break;	// User table defaults to sine
+			}
+			t[i] = static_cast<int16_t>(s * 32767.0f);
+		}
+		return t;
+	}
+
+	// Not const so held in RAM: user table may be overwritten at run time (keep guard entry equal to entry 0)
+	static inline std::array<Table, count> tables = {
+		MakeTable(triangle), MakeTable(saw), MakeTable(square), MakeTable(stepped), MakeTable(user)
+	};
+};
@@ -15,7 +15,7 @@ struct ConfigSaver {
 class Config {
 	friend class CDCHandler;					// Allow the serial handler access to private data for printing
 public:
-	static constexpr uint8_t configVersion = 1;
+	static constexpr uint8_t configVersion = 9;
 	
 	// STM32G473 category 3 device 256k Flash in 128 pages of 2048k (though memory browser indicates part actually has 512k??)
 	static constexpr uint32_t flashConfigPage = 100;	// Config start page
@@ -49,6 +49,105 @@ public:
 		return Cordic::ToFloat();
 	}
 
+	static int32_t SinQ31(uint32_t x)					// Return raw q1.31 result for fixed point processing
+	{
+		CORDIC->CSR = (1 << CORDIC_CSR_FUNC_Pos) | 		// 0: Cos, 1: Sin, 2: Phase, 3: Modulus, 4: Arctan, 5: cosh, 6: sinh, 7: Arctanh, 8: ln, 9: Square Root
+				(6 << CORDIC_CSR_PRECISION_Pos);		// Set precision to 6 (gives 6 * 4 = 24 iterations in 6 clock cycles)
+
+		CORDIC->WDATA = x;
+		return static_cast<int32_t>(CORDIC->RDATA);
+	}
+
+	// Pipelined API: configure function once, then overlap writing arguments with reading and processing results
+	static void SetSin()
+	{
+		CORDIC->CSR = (1 << CORDIC_CSR_FUNC_Pos) | 		// 0: Cos, 1: Sin, 2: Phase, 3: Modulus, 4: Arctan, 5: cosh, 6: sinh, 7: Arctanh, 8: ln, 9: Square Root
+				(6 << CORDIC_CSR_PRECISION_Pos);		// Set precision to 6 (gives 6 * 4 = 24 iterations in 6 clock cycles)
+	}
+
+	static void Write(uint32_t x)
+	{
+		CORDIC->WDATA = x;
+	}
+
+	static int32_t ReadQ31()							// Will block until RDATA is ready
+	{
+		return static_cast<int32_t>(CORDIC->RDATA);
+	}
+
+	static void SinQ31(const uint32_t* x, int32_t* result, const uint32_t count)
+	{
+		SetSin();
+		CORDIC->WDATA = x[0];
+		for (uint32_t i = 1; i < count; ++i) {
+			const int32_t r = static_cast<int32_t>(CORDIC->RDATA);
+			CORDIC->WDATA = x[i];						// Issue next argument before storing previous result
+			result[i - 1] = r;
+		}
+		result[count - 1] = static_cast<int32_t>(CORDIC->RDATA);
+	}
+
+	static void SinCosQ31(const uint32_t* x, int32_t* sin, int32_t* cos, const uint32_t count)
+	{
+		CORDIC->CSR = (1 << CORDIC_CSR_FUNC_Pos) | 		// 0: Cos, 1: Sin, 2: Phase, 3: Modulus, 4: Arctan, 5: cosh, 6: sinh, 7: Arctanh, 8: ln, 9: Square Root
+				CORDIC_CSR_NRES |						// 2 Results: sine then cosine from the same operation
+				(6 << CORDIC_CSR_PRECISION_Pos);		// Set precision to 6 (gives 6 * 4 = 24 iterations in 6 clock cycles)
+
+		CORDIC->WDATA = x[0];
+		for (uint32_t i = 1; i < count; ++i) {
+			const int32_t s = static_cast<int32_t>(CORDIC->RDATA);
+			const int32_t c = static_cast<int32_t>(CORDIC->RDATA);
+			CORDIC->WDATA = x[i];						// Issue next argument before storing previous results
+			sin[i - 1] = s;
+			cos[i - 1] = c;
+		}
+		sin[count - 1] = static_cast<int32_t>(CORDIC->RDATA);
+		cos[count - 1] = static_cast<int32_t>(CORDIC->RDATA);
+	}
+
+	// DMA batch mode: CORDIC write and read DMA requests transfer arguments and results (DMA2 channels 1 and 2, configured in InitCordic)
+	// Completion can be polled with BatchComplete() or signalled by interrupt through batchCallback
+	static inline void (*batchCallback)() = nullptr;
+
+	static void SinQ31DMA(const uint32_t* x, int32_t* result, const uint32_t count, const bool withCos = false)
+	{
+		DMA2_Channel1->CCR &= ~DMA_CCR_EN;
+		DMA2_Channel2->CCR &= ~DMA_CCR_EN;
+		DMA2->IFCR = 0xFF << DMA_IFCR_CGIF1_Pos;		// clear all interrupts for both streams
+
+		DMA2_Channel1->CMAR = (uint32_t)x;
+		DMA2_Channel1->CNDTR = count;
+		DMA2_Channel2->CMAR = (uint32_t)result;
+		DMA2_Channel2->CNDTR = withCos ? count * 2 : count;	// With cosine results are interleaved: sin, cos, sin ...
+
+		if (batchCallback != nullptr) {
+			DMA2_Channel2->CCR |= DMA_CCR_TCIE;
+		} else {
+			DMA2_Channel2->CCR &= ~DMA_CCR_TCIE;
+		}
+		DMA2_Channel2->CCR |= DMA_CCR_EN;
+		DMA2_Channel1->CCR |= DMA_CCR_EN;
+
+		CORDIC->CSR = (1 << CORDIC_CSR_FUNC_Pos) | 		// 0: Cos, 1: Sin, 2: Phase, 3: Modulus, 4: Arctan, 5: cosh, 6: sinh, 7: Arctanh, 8: ln, 9: Square Root
+				(withCos ? CORDIC_CSR_NRES : 0) |		// Second result is cosine
+				(6 << CORDIC_CSR_PRECISION_Pos) |		// Set precision to 6 (gives 6 * 4 = 24 iterations in 6 clock cycles)
+				CORDIC_CSR_DMAREN | CORDIC_CSR_DMAWEN;	// Request DMA to write arguments and read results
+	}
+
+	static bool BatchComplete()
+	{
+		return DMA2_Channel2->CNDTR == 0;
+	}
+
+	static void BatchInterrupt()						// Called from DMA2 channel 2 transfer complete interrupt
+	{
+		DMA2->IFCR = DMA_IFCR_CTCIF2;
+		CORDIC->CSR &= ~(CORDIC_CSR_DMAREN | CORDIC_CSR_DMAWEN);
+		if (batchCallback != nullptr) {
+			batchCallback();
+		}
+	}
+
 	static float SinNormal(uint32_t x)					// Use x directly, without conversion to float
 	{
 		CORDIC->CSR = (1 << CORDIC_CSR_FUNC_Pos) | 		// 0: Cos, 1: Sin, 2: Phase, 3: Modulus, 4: Arctan, 5: cosh, 6: sinh, 7: Arctanh, 8: ln, 9: Square Root
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+
+// Fixed point helpers: integer only so results are identical on target and host builds
+
+static constexpr float q31ToFloat = 1.0f / 2147483648.0f;
+
+inline constexpr int32_t MultQ31(const int32_t a, const int32_t b)
+{
+	return static_cast<int32_t>((static_cast<int64_t>(a) * b) >> 31);		// Compiles to SMULL on Cortex-M4
+}
+
+inline constexpr float Q31ToFloat(const int32_t x)
+{
+	return static_cast<float>(x) * q31ToFloat;
+}
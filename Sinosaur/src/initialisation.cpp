@@ -54,6 +54,9 @@ void InitHardware()
 	InitADC3(&adc.Sine2_Rate, 4);
 	InitADC4(&adc.Sine1_Rate, 5);
 	InitCordic();
+	InitCycleCounter();
+	InitClockInput();
+	InitGateInput();
 }
 
 
@@ -118,6 +121,17 @@ void InitDAC()
 }
 
 
+void ValidateDacCalibration()
+{
+	// Restore defaults for any output without a plausible calibration (eg config saved before calibration existed)
+	for (auto& cal : dacCalibration) {
+		if (cal.gain < DacCalibration::unityGain / 2 || cal.gain > DacCalibration::unityGain + DacCalibration::unityGain / 2) {
+			cal = {.offset = 0, .gain = DacCalibration::unityGain};
+		}
+	}
+}
+
+
 void InitPWMTimer()
 {
 	// TIM3: PE2 - PE5
@@ -180,19 +194,78 @@ void InitPWMTimer()
 }
 
 
-//	Setup Timer 5 on an interrupt to trigger outputs
+//	Setup Timer 5 to trigger outputs: on an interrupt in single sample mode or with DMA requests to stream DAC buffer in block mode
 void InitOutputTimer()
 {
 	RCC->APB1ENR1 |= RCC_APB1ENR1_TIM5EN;			// Enable Timer 5
-	TIM5->PSC = 16;									// Set prescaler
-	TIM5->ARR = 250; 								// Set auto reload register - 170Mhz / (PSC + 1) / ARR = ~40kHz
-
-	TIM5->DIER |= TIM_DIER_UIE;						// DMA/interrupt enable register
-	NVIC_EnableIRQ(TIM5_IRQn);
-	NVIC_SetPriority(TIM5_IRQn, 0);					// Lower is higher priority
+	TIM5->PSC = OutputTimerPrescaler;				// Set prescaler
+	TIM5->ARR = OutputTimerReload; 					// Set auto reload register - 170Mhz / (PSC + 1) / (ARR + 1) = SampleRate
+	TIM5->CR1 |= TIM_CR1_ARPE;						// Buffer reload so sample rate changes apply at the next update (counter never passes a shorter ARR)
+	TIM5->EGR |= TIM_EGR_UG;						// Re-initializes counter and loads prescaler: before DMA/interrupt enable so no request is issued
+	TIM5->SR &= ~TIM_SR_UIF;
+
+	if constexpr (BlockSize == 1) {
+		TIM5->DIER |= TIM_DIER_UIE;					// DMA/interrupt enable register
+		NVIC_EnableIRQ(TIM5_IRQn);
+		NVIC_SetPriority(TIM5_IRQn, 1);				// Lower is higher priority: below clock/gate edge interrupts
+	} else {
+		InitDacDMA();
+
+		// Each DAC's DMA channel is triggered by a different TIM5 event; stagger capture compare requests after the update event
+		TIM5->CCR1 = 8;
+		TIM5->CCR2 = 16;
+		TIM5->CCR3 = 24;
+		TIM5->DIER |= TIM_DIER_UDE | TIM_DIER_CC1DE | TIM_DIER_CC2DE | TIM_DIER_CC3DE;
+	}
 
 	TIM5->CR1 |= TIM_CR1_CEN;
-	TIM5->EGR |= TIM_EGR_UG;						//  Re-initializes counter and generates update of registers
+}
+
+
+void InitDacDMA()
+{
+	// DMA1 channels 4-7 transfer from circular dacBuffer to DAC1-DAC4 dual channel holding registers on TIM5 events
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMAMUX1EN;
+
+	struct {
+		DMA_Channel_TypeDef* dmaChannel;
+		DMAMUX_Channel_TypeDef* dmaMux;
+		DAC_TypeDef* dac;
+		uint32_t request;							// DMA request MUX input (See p.427)
+	} dacDMA[4] = {
+		{DMA1_Channel4, DMAMUX1_Channel3, DAC1, 76},	// 76 = TIM5_UP
+		{DMA1_Channel5, DMAMUX1_Channel4, DAC2, 72},	// 72 = TIM5_CH1
+		{DMA1_Channel6, DMAMUX1_Channel5, DAC3, 73},	// 73 = TIM5_CH2
+		{DMA1_Channel7, DMAMUX1_Channel6, DAC4, 74},	// 74 = TIM5_CH3
+	};
+
+	for (uint32_t i = 0; i < 4; ++i) {
+		auto& d = dacDMA[i];
+		d.dmaChannel->CCR &= ~DMA_CCR_EN;
+		d.dmaChannel->CCR |= DMA_CCR_DIR;			// Read from memory
+		d.dmaChannel->CCR |= DMA_CCR_CIRC;			// Circular mode to keep streaming buffer
+		d.dmaChannel->CCR |= DMA_CCR_MINC;			// Memory in increment mode
+		d.dmaChannel->CCR |= DMA_CCR_PSIZE_1;		// Peripheral size: 8 bit; 01 = 16 bit; 10 = 32 bit
+		d.dmaChannel->CCR |= DMA_CCR_MSIZE_1;		// Memory size: 8 bit; 01 = 16 bit; 10 = 32 bit
+		d.dmaChannel->CCR |= DMA_CCR_PL_1;			// Priority: 00 = low; 01 = Medium; 10 = High; 11 = Very High
+
+		d.dmaMux->CCR |= d.request;
+
+		d.dmaChannel->CNDTR = DacBufferSize;		// Number of data items to transfer (ie size of DAC buffer)
+		d.dmaChannel->CPAR = (uint32_t)(&(d.dac->DHR12RD));
+		d.dmaChannel->CMAR = (uint32_t)(dacBuffer[i]);
+	}
+
+	// DAC4 is last to be transferred each sample: use its half and full transfer interrupts to render next block
+	DMA1_Channel7->CCR |= DMA_CCR_HTIE | DMA_CCR_TCIE;
+	DMA1->IFCR = 0xFFFF << DMA_IFCR_CGIF4_Pos;		// clear all four interrupts for each of the DAC streams
+	NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+	NVIC_SetPriority(DMA1_Channel7_IRQn, 1);		// Lower is higher priority: below clock/gate edge interrupts
+
+	for (auto& d : dacDMA) {
+		d.dmaChannel->CCR |= DMA_CCR_EN;
+	}
 }
 
 
@@ -459,8 +532,64 @@ void InitADC4(volatile uint16_t* buffer, uint16_t channels)
 void InitCordic()
 {
 	RCC->AHB1ENR |= RCC_AHB1ENR_CORDICEN;
+
+	// DMA2 channel 1 writes CORDIC arguments and channel 2 reads results for batch mode
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMAMUX1EN;
+
+	DMA2_Channel1->CCR |= DMA_CCR_DIR;				// Read from memory
+	DMA2_Channel1->CCR |= DMA_CCR_MINC;				// Memory in increment mode
+	DMA2_Channel1->CCR |= DMA_CCR_PSIZE_1;			// Peripheral size: 8 bit; 01 = 16 bit; 10 = 32 bit
+	DMA2_Channel1->CCR |= DMA_CCR_MSIZE_1;			// Memory size: 8 bit; 01 = 16 bit; 10 = 32 bit
+	DMA2_Channel1->CPAR = (uint32_t)(&(CORDIC->WDATA));
+	DMAMUX1_Channel8->CCR |= 101; 					// DMA request MUX input 101 = CORDIC_WRITE (See p.427)
+
+	DMA2_Channel2->CCR |= DMA_CCR_MINC;				// Memory in increment mode
+	DMA2_Channel2->CCR |= DMA_CCR_PSIZE_1;			// Peripheral size: 8 bit; 01 = 16 bit; 10 = 32 bit
+	DMA2_Channel2->CCR |= DMA_CCR_MSIZE_1;			// Memory size: 8 bit; 01 = 16 bit; 10 = 32 bit
+	DMA2_Channel2->CCR |= DMA_CCR_PL_0;				// Priority: 00 = low; 01 = Medium; 10 = High; 11 = Very High
+	DMA2_Channel2->CPAR = (uint32_t)(&(CORDIC->RDATA));
+	DMAMUX1_Channel9->CCR |= 100; 					// DMA request MUX input 100 = CORDIC_READ (See p.427)
+
+	NVIC_EnableIRQ(DMA2_Channel2_IRQn);
+	NVIC_SetPriority(DMA2_Channel2_IRQn, 1);		// Lower is higher priority
 }
 
 
+void InitCycleCounter()
+{
+	// Enable DWT cycle counter used to benchmark processing
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
 
+void InitClockInput()
+{
+	// Clock input on PC12 triggers EXTI interrupt which timestamps edge with DWT cycle counter
+	SYSCFG->EXTICR[3] &= ~SYSCFG_EXTICR4_EXTI12;
+	SYSCFG->EXTICR[3] |= 2 << SYSCFG_EXTICR4_EXTI12_Pos;	// 0: PA, 1: PB, 2: PC
+	EXTI->FTSR1 |= EXTI_FTSR1_FT12;					// Falling edge (input is inverted)
+	EXTI->RTSR1 &= ~EXTI_RTSR1_RT12;
+	EXTI->PR1 = EXTI_PR1_PIF12;						// Clear any pending interrupt
+	EXTI->IMR1 |= EXTI_IMR1_IM12;
+
+	NVIC_SetPriority(EXTI15_10_IRQn, 0);			// Highest priority so timestamps are not delayed by output rendering
+	NVIC_EnableIRQ(EXTI15_10_IRQn);
+}
 
+
+void InitGateInput()
+{
+	// Gate input on PD0 triggers EXTI interrupt on both edges which timestamps edge with DWT cycle counter
+	SYSCFG->EXTICR[0] &= ~SYSCFG_EXTICR1_EXTI0;
+	SYSCFG->EXTICR[0] |= 3 << SYSCFG_EXTICR1_EXTI0_Pos;		// 0: PA, 1: PB, 2: PC, 3: PD
+	EXTI->FTSR1 |= EXTI_FTSR1_FT0;
+	EXTI->RTSR1 |= EXTI_RTSR1_RT0;
+	EXTI->PR1 = EXTI_PR1_PIF0;						// Clear any pending interrupt
+	EXTI->IMR1 |= EXTI_IMR1_IM0;
+
+	NVIC_SetPriority(EXTI0_IRQn, 0);				// Highest priority so timestamps are not delayed by output rendering
+	NVIC_EnableIRQ(EXTI0_IRQn);
+}
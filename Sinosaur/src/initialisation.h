@@ -30,7 +30,61 @@ extern GpioPin debugPin1;
 extern GpioPin debugPin2;
 
 #define sysTickInterval 1000						// 1ms
-static constexpr uint32_t SampleRate =  40000;
+
+// Sample rate build variant (eg 20000, 40000, 48000 or 96000) can be selected with SAMPLE_RATE compiler define; all rate dependent constants derive from this
+#ifndef SAMPLE_RATE
+#define SAMPLE_RATE 40000
+#endif
+static constexpr uint32_t SampleRate = SAMPLE_RATE;
+static constexpr float PhaseIncPerHz = 4294967296.0f / SampleRate;		// 32 bit phase increment per sample for 1Hz
+
+// TIM5 output timer settings: prescaler only needed if reload exceeds 16 bits
+static constexpr uint32_t SystemClock = 170'000'000;
+static constexpr uint32_t OutputTimerTicks = (SystemClock + SampleRate / 2) / SampleRate;
+static constexpr uint32_t OutputTimerPrescaler = (OutputTimerTicks - 1) / 65536;
+static constexpr uint32_t OutputTimerReload = OutputTimerTicks / (OutputTimerPrescaler + 1) - 1;
+static constexpr uint32_t BlockSize = 8;			// Samples rendered per block: 1 renders in TIM5 interrupt; 8 or 32 stream double buffered blocks to the DACs with DMA
+static_assert(BlockSize == 1 || BlockSize == 8 || BlockSize == 32, "Block size must be 1, 8 or 32 samples");
+static constexpr uint32_t ControlRate = 2000;		// Rate at which envelopes and control targets are calculated: set to SampleRate for single rate engine
+static constexpr uint32_t ControlInterval = SampleRate / ControlRate;
+static constexpr float controlIntervalRecip = 1.0f / ControlInterval;
+static_assert(SampleRate % ControlRate == 0, "Sample rate must be a multiple of control rate");
+
+// DAC output buffer holding two blocks per DAC in DHR12RD format (channel 1 in low half-word, channel 2 in high half-word)
+static constexpr uint32_t DacBufferSize = BlockSize * 2;
+extern uint32_t dacBuffer[4][DacBufferSize];
+
+// Per output calibration for DAC offset and output stage gain errors: out = (val + curve correction) * gain + offset
+struct DacCalibration {
+	static constexpr uint32_t outputs = 8;			// 4 DACs x 2 channels: indexed by (dac - 1) * 2 + (channel - 1)
+	static constexpr uint32_t curvePoints = 33;		// Correction curve points every 128 DAC LSBs (including full scale)
+	static constexpr uint16_t unityGain = 32768;
+
+	int16_t offset;									// In DAC LSBs
+	uint16_t gain;									// q1.15 format (32768 = 1.0)
+	int16_t curve[curvePoints];						// Correction in DAC LSBs, interpolated between points
+};
+extern DacCalibration dacCalibration[DacCalibration::outputs];
+void ValidateDacCalibration();
+
+struct DacChannel {
+	uint16_t* samples = nullptr;
+	const DacCalibration* cal = nullptr;
+
+	DacChannel() = default;
+	DacChannel(const uint32_t dac, const uint32_t channel)		// DAC and channel numbered from 1
+	 : samples{reinterpret_cast<uint16_t*>(dacBuffer[dac - 1]) + (channel - 1)},
+	   cal{&dacCalibration[(dac - 1) * 2 + (channel - 1)]} {};
+
+	// Calibration applied with integer maths only so it can run at the full sample rate on every output
+	void Set(const uint32_t pos, const uint32_t val) {
+		const uint32_t v = std::min(val, (uint32_t)4095);
+		const uint32_t i = v >> 7;
+		const int32_t correction = cal->curve[i] + (((cal->curve[i + 1] - cal->curve[i]) * (int32_t)(v & 127)) >> 7);
+		samples[pos * 2] = __USAT(((((int32_t)v + correction) * cal->gain) >> 15) + cal->offset, 12);
+	}
+	uint16_t Get(const uint32_t pos) { return samples[pos * 2]; }
+};
 
 static constexpr float pi = std::numbers::pi_v<float>;
 static constexpr float pi_x_2 = pi * 2.0f;
@@ -44,5 +98,9 @@ void InitADC1(volatile uint16_t* buffer, uint16_t channels);
 void InitADC3(volatile uint16_t* buffer, uint16_t channels);
 void InitADC4(volatile uint16_t* buffer, uint16_t channels);
 void InitCordic();
+void InitCycleCounter();
+void InitClockInput();
+void InitGateInput();
 void InitPWMTimer();
 void InitOutputTimer();
+void InitDacDMA();
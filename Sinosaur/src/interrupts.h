@@ -4,11 +4,56 @@ void SysTick_Handler(void)
 }
 
 
-// Output timer
+// Output timer (single sample mode)
 void TIM5_IRQHandler(void)
 {
 	TIM5->SR &= ~TIM_SR_UIF;					// clear UIF flag
-	modulation.CalcLFO();
+	const bool overBudget = modulation.CalcBlock(0);
+	if (!overBudget && (TIM5->SR & TIM_SR_UIF)) {	// Next update already due: sample missed (count each late render once)
+		modulation.Overrun();
+	}
+}
+
+
+// DAC4 DMA (block mode): refill the half of the DAC buffer that has just been transferred
+void DMA1_Channel7_IRQHandler(void)
+{
+	bool overBudget = false;
+	if (DMA1->ISR & DMA_ISR_HTIF7) {
+		DMA1->IFCR = DMA_IFCR_CHTIF7;
+		overBudget |= modulation.CalcBlock(0);
+	}
+	if (DMA1->ISR & DMA_ISR_TCIF7) {
+		DMA1->IFCR = DMA_IFCR_CTCIF7;
+		overBudget |= modulation.CalcBlock(BlockSize);
+	}
+	if (!overBudget && (DMA1->ISR & (DMA_ISR_HTIF7 | DMA_ISR_TCIF7))) {	// Next half already transferred: block missed (count each late render once)
+		modulation.Overrun();
+	}
+}
+
+// Clock input on PC12 (inverted so falling edge is clock rising): timestamp edge at CPU clock resolution
+void EXTI15_10_IRQHandler(void)
+{
+	if (EXTI->PR1 & EXTI_PR1_PIF12) {
+		const uint32_t time = DWT->CYCCNT;
+		EXTI->PR1 = EXTI_PR1_PIF12;
+		modulation.clockEdges.Push(time, true);
+	}
+}
+
+// Gate input on PD0 (inverted): both edges timestamped; level read after edge gives direction
+void EXTI0_IRQHandler(void)
+{
+	const uint32_t time = DWT->CYCCNT;
+	EXTI->PR1 = EXTI_PR1_PIF0;
+	modulation.gateEdges.Push(time, (GPIOD->IDR & GPIO_IDR_ID0) == 0);
+}
+
+// CORDIC DMA batch complete
+void DMA2_Channel2_IRQHandler(void)
+{
+	Cordic::BatchInterrupt();
 }
 
 void NMI_Handler(void) {}
@@ -0,0 +1,123 @@
+#pragma once
+#include "initialisation.h"
+#include <cmath>
+
+// Compile time generated tables indexed directly by 12 bit ADC values to replace pow calculations in the output interrupt
+
+namespace Curve {
+	struct Square {						// Square the value to increase resolution at low settings
+		static constexpr float Apply(const float x) { return x * x; }
+	};
+
+	template<uint32_t octaves>
+	struct Exponential {				// Doubles every 1/octaves of travel (1V/oct style), normalised to 0 - 1
+		static constexpr float Apply(const float x) { return (std::exp2(x * octaves) - 1.0f) / (std::exp2(float(octaves)) - 1.0f); }
+	};
+}
+
+// Select curve shapes here
+using LfoRateCurve = Curve::Square;
+using EnvRateCurve = Curve::Square;
+using LedGammaCurve = Curve::Square;
+
+static constexpr uint32_t adcTableSize = 4096;
+
+// Generate table of curve applied to (offset + adc) / 4095
+template<typename Shape, uint32_t offset = 0>
+constexpr std::array<float, adcTableSize> MakeAdcTable()
+{
+	std::array<float, adcTableSize> table {};
+	for (uint32_t i = 0; i < adcTableSize; ++i) {
+		table[i] = Shape::Apply((offset + i) * reciprocal4096);
+	}
+	return table;
+}
+
+// LED PWM level from 12 bit output level
+template<typename Shape>
+constexpr std::array<uint16_t, adcTableSize> MakeGammaTable()
+{
+	std::array<uint16_t, adcTableSize> table {};
+	for (uint32_t i = 0; i < adcTableSize; ++i) {
+		table[i] = static_cast<uint16_t>(Shape::Apply(i * reciprocal4096) * 4095.0f);
+	}
+	return table;
+}
+
+inline constexpr auto lfoRateTable = MakeAdcTable<LfoRateCurve>();
+inline constexpr auto rampRateTable = MakeAdcTable<EnvRateCurve, 500>();		// Offsets give ramp and swell a minimum rate
+inline constexpr auto swellRateTable = MakeAdcTable<EnvRateCurve, 100>();
+inline constexpr auto ledGammaTable = MakeGammaTable<LedGammaCurve>();
+
+
+// Clock period multipliers selected by rate control in clock mode: LFO cycle spans num / den clock periods (slowest first)
+// Weight sets the share of the rate control's travel given to each multiplier (straight values wider than dotted and triplet)
+struct ClockMult {
+	uint8_t num;
+	uint8_t den;
+	uint8_t weight;
+};
+inline constexpr ClockMult clockMults[] = {
+	{16, 1, 2}, {8, 1, 2}, {6, 1, 1}, {4, 1, 2}, {3, 1, 1}, {8, 3, 1}, {2, 1, 2}, {3, 2, 1}, {4, 3, 1}, {1, 1, 2},
+	{3, 4, 1}, {2, 3, 1}, {1, 2, 2}, {3, 8, 1}, {1, 3, 1}, {1, 4, 2}, {1, 6, 1}, {1, 8, 2}, {1, 16, 2}
+};
+inline constexpr uint32_t clockMultCount = std::size(clockMults);
+
+constexpr uint32_t FindClockMult(const uint8_t num, const uint8_t den)
+{
+	for (uint32_t i = 0; i < clockMultCount; ++i) {
+		if (clockMults[i].num == num && clockMults[i].den == den) {
+			return i;
+		}
+	}
+	return clockMultCount;
+}
+inline constexpr uint32_t clockMultUnity = FindClockMult(1, 1);		// Used as master rate for ratio locked LFOs
+static_assert(clockMultUnity < clockMultCount, "Clock multipliers must include 1x");
+
+// Window of rate control (0 - 4095) selecting each multiplier: upper bounds are searched to select a new multiplier;
+// selection only changes once control leaves the current window extended by hysteresis (a quarter of window width)
+struct ClockMultWindow {
+	uint16_t upper;						// Exclusive upper bound of window
+	uint16_t hystLower;					// Current multiplier kept while control is within hystLower to hystUpper
+	uint16_t hystUpper;
+};
+
+constexpr std::array<ClockMultWindow, clockMultCount> MakeClockMultWindows()
+{
+	uint32_t totalWeight = 0;
+	for (const auto& m : clockMults) {
+		totalWeight += m.weight;
+	}
+
+	std::array<ClockMultWindow, clockMultCount> windows {};
+	uint32_t weight = 0;
+	uint32_t lower = 0;
+	for (uint32_t i = 0; i < clockMultCount; ++i) {
+		weight += clockMults[i].weight;
+		const uint32_t upper = weight * adcTableSize / totalWeight;
+		const uint32_t hyst = (upper - lower) / 4;
+		windows[i] = {
+			.upper = static_cast<uint16_t>(upper),
+			.hystLower = static_cast<uint16_t>(lower > hyst ? lower - hyst : 0),
+			.hystUpper = static_cast<uint16_t>(upper + hyst)
+		};
+		lower = upper;
+	}
+	return windows;
+}
+inline constexpr auto clockMultWindows = MakeClockMultWindows();
+
+// Binary search for window containing control value
+inline uint32_t SelectClockMult(const uint32_t control)
+{
+	uint32_t first = 0;
+	uint32_t count = clockMultCount - 1;		// Last window's upper bound is above any control value
+	while (count > 0) {
+		const uint32_t half = count / 2;
+		const bool above = control >= clockMultWindows[first + half].upper;
+		first = above ? first + half + 1 : first;
+		count = above ? count - half - 1 : half;
+	}
+	return first;
+}
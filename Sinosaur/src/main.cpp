@@ -1,10 +1,23 @@
 #include "initialisation.h"
 #include "Modulation.h"
+#include "Benchmark.h"
+#include "Cordic.h"
 
 volatile uint32_t SysTickVal;
 volatile ADCValues adc;
+uint32_t dacBuffer[4][DacBufferSize];
+DacCalibration dacCalibration[DacCalibration::outputs] = {
+	{.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain},
+	{.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain}, {.gain = DacCalibration::unityGain}
+};
 
-Config config{&modulation.configSaver};		// Construct config handler with list of configSavers
+ConfigSaver calibrationSaver = {
+	.settingsAddress = &dacCalibration,
+	.settingsSize = sizeof(dacCalibration),
+	.validateSettings = &ValidateDacCalibration
+};
+
+Config config{&modulation.configSaver, &calibrationSaver};		// Construct config handler with list of configSavers
 
 extern "C" {
 #include "interrupts.h"
@@ -18,11 +31,15 @@ int main(void)
 	InitClocks();						// Configure the clock and PLL
 	InitHardware();
 	config.RestoreConfig();
+#ifdef DEBUG
+	benchmark.Run();
+#endif
 	modulation.Init();
 	InitOutputTimer();
 
 	while (1) {
 		config.SaveConfig();			// Save any scheduled changes
+		modulation.UpdateMatrix();		// Rebuild modulation matrix ops after any route change
 	}
 }
 
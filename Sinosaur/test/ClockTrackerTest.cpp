@@ -0,0 +1,93 @@
+// Host test for clock tracker: feeds synthetic clock edge streams (steady, swung, jittered and restarted) through ClockTracker
+// Build and run from this directory: g++ -std=c++20 -I../src ClockTrackerTest.cpp -o ClockTrackerTest && ./ClockTrackerTest
+
+#include "ClockTracker.h"
+#include <cstdio>
+#include <random>
+
+static uint32_t failures = 0;
+
+static void Check(const bool ok, const char* test, const char* what, const float value)
+{
+	if (!ok) {
+		printf("FAIL %s: %s (%.0f)\n", test, what, value);
+		++failures;
+	}
+}
+
+
+// Swung clock: alternate intervals of swing and 1 - swing of each pair of periods; tracked period must stay near the mean
+static void Swing(const float swing)
+{
+	ClockTracker tracker;
+	tracker.SetLockTime(16);
+	const uint32_t period = 1'000'000;
+	uint32_t time = 0xFFF00000;							// Cross counter wrap
+	for (uint32_t edge = 0; edge < 400; ++edge) {
+		tracker.Edge(time);
+		if (edge >= 8) {
+			Check(std::abs(tracker.period - period) < period * 0.05f, "swing", "period flipped from mean", tracker.period);
+		}
+		time += static_cast<uint32_t>(2 * period * (edge & 1 ? 1.0f - swing : swing));
+	}
+}
+
+
+// Clock stops and restarts at a new tempo: first periods after restart must come from new intervals only
+static void Restart()
+{
+	ClockTracker tracker;
+	tracker.SetLockTime(16);
+	uint32_t time = 0;
+	for (uint32_t edge = 0; edge < 20; ++edge) {
+		tracker.Edge(time);
+		time += 1'000'000;
+	}
+	tracker.Reset();
+
+	time += 500'000'000;
+	for (uint32_t edge = 0; edge < 20; ++edge) {
+		const bool valid = tracker.Edge(time);
+		Check(valid == (edge > 0), "restart", "period validity", edge);
+		if (valid) {
+			Check(std::abs(tracker.period - 400'000.0f) < 400.0f, "restart", "stale interval in period", tracker.period);
+		}
+		time += 400'000;
+	}
+}
+
+
+// Jittered clock with occasional missed edges: period stays locked and tempo change relocks
+static void Jitter()
+{
+	ClockTracker tracker;
+	tracker.SetLockTime(16);
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int32_t> jitter(-5000, 5000);
+	uint32_t grid = 0;
+	uint32_t period = 850'000;
+	for (uint32_t edge = 0; edge < 2000; ++edge) {
+		if (edge == 1000) {
+			period = 600'000;								// Tempo change
+		}
+		if (edge % 97 != 0) {								// Missed edge
+			tracker.Edge(grid + jitter(rng));
+		}
+		if (edge > 30 && (edge < 1000 || edge > 1030)) {
+			Check(std::abs(tracker.period - period) < period * 0.01f, "jitter", "period not locked", tracker.period);
+		}
+		grid += period;
+	}
+}
+
+
+int main()
+{
+	Swing(0.5f);
+	Swing(0.6f);
+	Swing(0.67f);
+	Restart();
+	Jitter();
+	printf("ClockTracker: %s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+// Host test for gate edge placement: feeds synthetic edge streams through GateEvent::Place
+// Build and run from this directory: g++ -std=c++20 -I../src EdgeTimingTest.cpp -o EdgeTimingTest && ./EdgeTimingTest
+
+#include "EdgeTiming.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static constexpr uint32_t blockSize = 8;
+static constexpr uint32_t sampleTicks = 4250;				// CPU cycles per sample at 170MHz / 40kHz
+static constexpr uint32_t blockTicks = blockSize * sampleTicks;
+
+static uint32_t failures = 0;
+
+static void Check(const bool ok, const char* what, const uint32_t block)
+{
+	if (!ok) {
+		printf("FAIL block %lu: %s\n", (unsigned long)block, what);
+		++failures;
+	}
+}
+
+
+// Places edges received since the last block, checking each against its true time and the time of the previous
+// placed edge: the sample position and offset of every event, taken from the block start, must rebuild a timeline that
+// matches the edges to within a cycle and never runs backwards across block boundaries
+static void RunBlock(const uint32_t now, const std::vector<uint32_t>& edges, uint32_t& lastPlaced, const uint32_t block)
+{
+	bool rising = true;
+	for (const uint32_t time : edges) {
+		const GateEvent e = GateEvent::Place(now, time, rising, sampleTicks, blockSize);
+		rising = !rising;
+		Check(e.pos < blockSize, "position outside block", block);
+
+		// Time of edge as replayed: block start less samples before end of block and offset from edge to sample
+		const uint32_t placedAge = (blockSize - 1 - e.pos) * sampleTicks + static_cast<uint32_t>(((uint64_t)e.offset * sampleTicks) >> 16);
+		const uint32_t placed = now - placedAge;
+		const int32_t age = static_cast<int32_t>(now - time);
+		if (age < 0) {
+			Check(placed == now, "edge newer than block start not placed at end", block);
+		} else {
+			Check(std::abs(static_cast<int32_t>(placed - time)) <= 1, "placement differs from edge time", block);
+			if ((uint32_t)age < blockTicks) {
+				Check(e.offset < 65536, "offset of a sample or more within block", block);
+			} else {
+				Check(e.pos == 0, "old edge not applied at start", block);
+			}
+		}
+		Check(static_cast<int32_t>(placed - lastPlaced) >= 0, "replayed edges out of order", block);
+		lastPlaced = placed;
+	}
+}
+
+
+int main()
+{
+	std::mt19937 rng(1);
+	uint32_t now = 0xFFFF0000;								// Start close to counter wrap
+	uint32_t last = now - blockTicks;
+	uint32_t lastPlaced = last - blockTicks;
+	uint32_t total = 0;
+
+	for (uint32_t block = 0; block < 100000; ++block) {
+		// Edges since the previous block start, with some pushed after this block's timestamp was read
+		std::vector<uint32_t> edges;
+		const uint32_t span = now - last;
+		const uint32_t count = rng() % 4;
+		for (uint32_t i = 0; i < count; ++i) {
+			edges.push_back(last + rng() % (span + sampleTicks));
+		}
+		std::sort(edges.begin(), edges.end(), [&](uint32_t a, uint32_t b) { return (int32_t)(a - last) < (int32_t)(b - last); });
+		total += edges.size();
+		RunBlock(now, edges, lastPlaced, block);
+
+		// Raced edges were stamped after this block's start: the next block's edges follow them
+		last = edges.empty() ? now : std::max(now, edges.back(), [&](uint32_t a, uint32_t b) { return (int32_t)(a - now) < (int32_t)(b - now); });
+		now += block % 100 == 0 ? blockTicks * 3 : blockTicks;	// Occasionally delayed block: edges span several blocks
+	}
+
+	printf("%lu edges: %s\n", (unsigned long)total, failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}